@@ -0,0 +1,753 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Headless benchmark for the ASCII pipeline, built with `make bench`.
+ *
+ * Compares the scalers on their own, then runs aatv on synthetic I420
+ * frames over every input size, canvas size, font, dither mode and rain
+ * mode and reports each stage of it. A full sweep takes a few minutes,
+ * pass a smaller iteration count for a quick look.
+ *
+ * Every result is printed as one line of space separated key=value pairs so
+ * runs can be compared with a script.
+ *
+ * With --check=FILE it instead renders a fixed set of short clips, in the
+ * raw video formats and as application/x-aatv-cells, and compares a
+ * checksum of every clip's output against the golden file, exiting with 1
+ * on any difference. The golden file is committed and written with
+ * --update=FILE from the scalar kernel, so every optimized kernel has to
+ * match it byte for byte. Every kernel is also compared with the per-pixel
+ * glyph expansion aatv used before the span table, which needs no golden
+ * file, and --update refuses to write one when that fails.
+ *
+ * Frame times only mean something on the machine they were taken on, so
+ * they live in a separate file written with --update-times=FILE. When
+ * --times=FILE exists --check also fails clips that got slower than
+ * --max-slowdown percent.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "gstaascale.h"
+#include "gstaatv.h"
+
+/* the nearest neighbour scaler aasink and aatv used before the area
+ * averaging one, kept as a baseline */
+static void
+bench_scale_nearest (const guint8 * src, gint sw, gint sh, gint ss,
+    guint8 * dest, gint dw, gint dh)
+{
+  gint ypos, yinc, y;
+  gint xpos, xinc, x;
+
+  ypos = 0x10000;
+  yinc = (sh << 16) / dh;
+  xinc = (sw << 16) / dw;
+
+  for (y = dh; y; y--) {
+    while (ypos > 0x10000) {
+      ypos -= 0x10000;
+      src += ss;
+    }
+    xpos = 0x10000;
+    {
+      guint8 *destp = dest;
+      const guint8 *srcp = src;
+
+      for (x = dw; x; x--) {
+        while (xpos >= 0x10000L) {
+          srcp++;
+          xpos -= 0x10000L;
+        }
+        *destp++ = *srcp;
+        xpos += xinc;
+      }
+    }
+    dest += dw;
+    ypos += yinc;
+  }
+}
+
+/* a luma plane with gradients and edges, so neither scaler hits a trivial
+ * case */
+static guint8 *
+bench_make_luma (gint width, gint height, gint stride, gint phase)
+{
+  guint8 *luma = g_malloc (stride * height);
+  gint x, y;
+
+  /* phase scrolls the pattern for moving clips */
+  for (y = 0; y < height; y++)
+    for (x = 0; x < stride; x++)
+      luma[y * stride + x] = ((x + phase) % width * 255 / width) ^
+          (((y + phase) / 16) & 1 ? 0xff : 0);
+
+  return luma;
+}
+
+static void
+bench_report (const gchar * stage, const gchar * variant, gint sw, gint sh,
+    gint dw, gint dh, gint iterations, gint64 elapsed_us)
+{
+  gdouble seconds = elapsed_us / (gdouble) G_USEC_PER_SEC;
+
+  g_print ("stage=%s variant=%s src=%dx%d dest=%dx%d iterations=%d "
+      "fps=%.1f ns_per_pixel=%.3f\n", stage, variant, sw, sh, dw, dh,
+      iterations, iterations / seconds,
+      elapsed_us * 1000.0 / ((gdouble) iterations * dw * dh));
+}
+
+static void
+bench_scalers (gint sw, gint sh, gint dw, gint dh, gint iterations)
+{
+  gint ss = (sw + 3) & ~3;
+  guint8 *src = bench_make_luma (sw, sh, ss, 0);
+  guint8 *dest = g_malloc (dw * dh);
+  GstAAScaler *scaler = gst_aa_scaler_new ();
+  gint64 start;
+  gint i;
+
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    bench_scale_nearest (src, sw, sh, ss, dest, dw, dh);
+  bench_report ("scale", "nearest", sw, sh, dw, dh, iterations,
+      g_get_monotonic_time () - start);
+
+  /* the first call builds the tap tables, keep it out of the timing */
+  gst_aa_scaler_scale (scaler, src, sw, sh, ss, dest, dw, dh);
+  start = g_get_monotonic_time ();
+  for (i = 0; i < iterations; i++)
+    gst_aa_scaler_scale (scaler, src, sw, sh, ss, dest, dw, dh);
+  bench_report ("scale", "area", sw, sh, dw, dh, iterations,
+      g_get_monotonic_time () - start);
+
+  gst_aa_scaler_free (scaler);
+  g_free (dest);
+  g_free (src);
+}
+
+/* I420 with the luma pattern above and neutral chroma */
+static GstBuffer *
+bench_make_i420 (GstVideoInfo * info, gint phase)
+{
+  GstBuffer *buffer = gst_buffer_new_allocate (NULL, info->size, NULL);
+  GstVideoFrame frame;
+  guint8 *luma;
+  gint width = GST_VIDEO_INFO_WIDTH (info);
+  gint height = GST_VIDEO_INFO_HEIGHT (info);
+  gint y;
+
+  gst_video_frame_map (&frame, info, buffer, GST_MAP_WRITE);
+
+  luma = bench_make_luma (width, height, width, phase);
+  for (y = 0; y < height; y++)
+    memcpy ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 0) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0), luma + y * width, width);
+  for (y = 0; y < (height + 1) / 2; y++) {
+    memset ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 1) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 1), 128, (width + 1) / 2);
+    memset ((guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&frame, 2) +
+        y * GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 2), 128, (width + 1) / 2);
+  }
+  g_free (luma);
+
+  gst_video_frame_unmap (&frame);
+
+  return buffer;
+}
+
+static const gchar *rain_names[] = { "off", "down", "up", "left", "right" };
+
+/* the stages aatv's stats property times, the frame stage covers all but
+ * the rain step */
+static const gchar *aatv_stages[] = { "rain", "scale", "match", "render",
+  "frame"
+};
+
+/* an aatv negotiated for I420 input of sw x sh and format output */
+static GstVideoFilter *
+bench_aatv_new (gint sw, gint sh, gint columns, gint rows, gint font,
+    gint dither, gint rain_mode, GstVideoFormat format, GstVideoInfo * in_info,
+    GstVideoInfo * out_info)
+{
+  GstVideoFilter *filter;
+
+  filter = g_object_new (GST_TYPE_AATV, "width", columns, "height", rows,
+      "font", font, "dither", dither, "rain-mode", rain_mode, NULL);
+
+  gst_video_info_set_format (in_info, GST_VIDEO_FORMAT_I420, sw, sh);
+  gst_video_info_set_format (out_info, format, columns * 8,
+      rows * aa_fonts[font]->height);
+  GST_VIDEO_FILTER_GET_CLASS (filter)->set_info (filter, NULL, in_info, NULL,
+      out_info);
+
+  return filter;
+}
+
+/* runs iterations frames through aatv the way GstBaseTransform would and
+ * reports the time of each stage */
+static void
+bench_aatv (gint sw, gint sh, gint columns, gint rows, gint font, gint dither,
+    gint rain_mode, gint iterations)
+{
+  GstVideoFilterClass *filter_class;
+  GstBaseTransformClass *trans_class;
+  GstVideoFilter *filter;
+  GstVideoInfo in_info, out_info;
+  GstVideoFrame in_frame, out_frame;
+  GstBuffer *inbuf, *outbuf;
+  guint64 totals[G_N_ELEMENTS (aatv_stages)] = { 0 };
+  gint64 start, elapsed_us = 0;
+  gint dw, dh, i;
+  guint j;
+
+  filter = bench_aatv_new (sw, sh, columns, rows, font, dither, rain_mode,
+      GST_VIDEO_FORMAT_RGBA, &in_info, &out_info);
+  filter_class = GST_VIDEO_FILTER_GET_CLASS (filter);
+  trans_class = GST_BASE_TRANSFORM_GET_CLASS (filter);
+  dw = GST_VIDEO_INFO_WIDTH (&out_info);
+  dh = GST_VIDEO_INFO_HEIGHT (&out_info);
+
+  inbuf = bench_make_i420 (&in_info, 0);
+  outbuf = gst_buffer_new_allocate (NULL, out_info.size, NULL);
+  gst_video_frame_map (&in_frame, &in_info, inbuf, GST_MAP_READ);
+  gst_video_frame_map (&out_frame, &out_info, outbuf, GST_MAP_WRITE);
+
+  /* the first frame builds aalib's tables */
+  trans_class->before_transform (GST_BASE_TRANSFORM (filter), inbuf);
+  filter_class->transform_frame (filter, &in_frame, &out_frame);
+
+  for (i = 0; i < iterations; i++) {
+    GstStructure *stats;
+
+    start = g_get_monotonic_time ();
+    trans_class->before_transform (GST_BASE_TRANSFORM (filter), inbuf);
+    filter_class->transform_frame (filter, &in_frame, &out_frame);
+    elapsed_us += g_get_monotonic_time () - start;
+
+    /* reading the stats allocates, keep it out of the timing */
+    g_object_get (filter, "stats", &stats, NULL);
+    for (j = 0; j < G_N_ELEMENTS (aatv_stages); j++) {
+      gchar *field = g_strconcat (aatv_stages[j], "-last", NULL);
+      guint64 last = 0;
+
+      gst_structure_get_uint64 (stats, field, &last);
+      totals[j] += last;
+      g_free (field);
+    }
+    gst_structure_free (stats);
+  }
+
+  for (j = 0; j < G_N_ELEMENTS (aatv_stages); j++)
+    g_print ("stage=%s variant=aatv src=%dx%d canvas=%dx%d dest=%dx%d "
+        "font=%s dither=%s rain=%s iterations=%d fps=%.1f "
+        "ns_per_pixel=%.3f\n", aatv_stages[j], sw, sh, columns, rows, dw, dh,
+        aa_fonts[font]->shortname, aa_dithernames[dither],
+        rain_names[rain_mode], iterations,
+        totals[j] ? iterations * 1e9 / totals[j] : 0.0,
+        totals[j] / ((gdouble) iterations * dw * dh));
+
+  /* wall clock of the whole element, including what the stages miss */
+  bench_report ("total", "aatv", sw, sh, dw, dh, iterations, elapsed_us);
+
+  gst_video_frame_unmap (&out_frame);
+  gst_video_frame_unmap (&in_frame);
+  gst_buffer_unref (outbuf);
+  gst_buffer_unref (inbuf);
+  gst_object_unref (filter);
+}
+
+/* frames per clip of the golden check */
+#define BENCH_CHECK_FRAMES 16
+
+typedef struct
+{
+  gchar checksum[41];
+  guint64 ns_per_frame;
+} BenchResult;
+
+static gint
+bench_compare_times (gconstpointer a, gconstpointer b)
+{
+  gint64 diff = *(const gint64 *) a - *(const gint64 *) b;
+
+  return diff < 0 ? -1 : diff > 0;
+}
+
+/* the --check formats, GST_VIDEO_FORMAT_UNKNOWN stands for the
+ * application/x-aatv-cells output */
+static const gchar *
+bench_format_name (GstVideoFormat format)
+{
+  if (format == GST_VIDEO_FORMAT_UNKNOWN)
+    return "cells";
+  return gst_video_format_to_string (format);
+}
+
+/* negotiates filter for the cells caps of its canvas, the way basetransform
+ * would after aatv offered them */
+static void
+bench_aatv_set_cells (GstVideoFilter * filter, GstVideoInfo * in_info,
+    gint columns, gint rows, gsize * size)
+{
+  GstCaps *incaps = gst_video_info_to_caps (in_info);
+  GstCaps *outcaps = gst_caps_new_simple (GST_AATV_CELLS_MEDIA_TYPE,
+      "width", G_TYPE_INT, columns, "height", G_TYPE_INT, rows, NULL);
+
+  GST_BASE_TRANSFORM_GET_CLASS (filter)->set_caps (GST_BASE_TRANSFORM
+      (filter), incaps, outcaps);
+  /* characters, attributes and flags */
+  *size = 3 * (gsize) columns * rows;
+
+  gst_caps_unref (outcaps);
+  gst_caps_unref (incaps);
+}
+
+/* renders a short moving clip, returns the sha1 of every visible output
+ * byte and the median frame time. The cells output hashes the whole
+ * buffer. */
+static void
+bench_check_clip (gint sw, gint sh, gint columns, gint rows, gint font,
+    gint dither, gint rain_mode, GstVideoFormat format, BenchResult * result)
+{
+  GstVideoFilterClass *filter_class;
+  GstBaseTransformClass *trans_class;
+  GstVideoFilter *filter;
+  GstVideoInfo in_info, out_info;
+  GstVideoFrame in_frame, out_frame;
+  GstBuffer *inbuf, *outbuf;
+  GChecksum *checksum = g_checksum_new (G_CHECKSUM_SHA1);
+  gint64 times[BENCH_CHECK_FRAMES];
+  gboolean cells = format == GST_VIDEO_FORMAT_UNKNOWN;
+  gsize size;
+  gint i, y;
+  guint plane;
+
+  /* the palette format doesn't matter to the cells */
+  filter = bench_aatv_new (sw, sh, columns, rows, font, dither, rain_mode,
+      cells ? GST_VIDEO_FORMAT_GRAY8 : format, &in_info, &out_info);
+  /* the bands aalib matches in depend on the thread count */
+  g_object_set (filter, "n-threads", 4, "seed", 1, NULL);
+  filter_class = GST_VIDEO_FILTER_GET_CLASS (filter);
+  trans_class = GST_BASE_TRANSFORM_GET_CLASS (filter);
+
+  size = out_info.size;
+  if (cells)
+    bench_aatv_set_cells (filter, &in_info, columns, rows, &size);
+  outbuf = gst_buffer_new_allocate (NULL, size, NULL);
+
+  for (i = 0; i < BENCH_CHECK_FRAMES; i++) {
+    gint64 start;
+
+    inbuf = bench_make_i420 (&in_info, i * 7);
+
+    if (cells) {
+      GstMapInfo map;
+
+      start = g_get_monotonic_time ();
+      trans_class->before_transform (GST_BASE_TRANSFORM (filter), inbuf);
+      trans_class->transform (GST_BASE_TRANSFORM (filter), inbuf, outbuf);
+      times[i] = (g_get_monotonic_time () - start) * 1000;
+
+      gst_buffer_map (outbuf, &map, GST_MAP_READ);
+      g_checksum_update (checksum, map.data, map.size);
+      gst_buffer_unmap (outbuf, &map);
+      gst_buffer_unref (inbuf);
+      continue;
+    }
+
+    gst_video_frame_map (&in_frame, &in_info, inbuf, GST_MAP_READ);
+    gst_video_frame_map (&out_frame, &out_info, outbuf, GST_MAP_WRITE);
+
+    start = g_get_monotonic_time ();
+    trans_class->before_transform (GST_BASE_TRANSFORM (filter), inbuf);
+    filter_class->transform_frame (filter, &in_frame, &out_frame);
+    times[i] = (g_get_monotonic_time () - start) * 1000;
+
+    /* leave row padding out, it is never written */
+    for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES (&out_frame); plane++)
+      for (y = 0; y < GST_VIDEO_FRAME_COMP_HEIGHT (&out_frame, plane); y++)
+        g_checksum_update (checksum,
+            (guint8 *) GST_VIDEO_FRAME_PLANE_DATA (&out_frame, plane) +
+            y * GST_VIDEO_FRAME_PLANE_STRIDE (&out_frame, plane),
+            GST_VIDEO_FRAME_COMP_WIDTH (&out_frame, plane) *
+            GST_VIDEO_FRAME_COMP_PSTRIDE (&out_frame, plane));
+
+    gst_video_frame_unmap (&out_frame);
+    gst_video_frame_unmap (&in_frame);
+    gst_buffer_unref (inbuf);
+  }
+
+  /* the first frame builds aalib's tables, leave it out */
+  qsort (times + 1, BENCH_CHECK_FRAMES - 1, sizeof (gint64),
+      bench_compare_times);
+  result->ns_per_frame = times[1 + (BENCH_CHECK_FRAMES - 1) / 2];
+  g_strlcpy (result->checksum, g_checksum_get_string (checksum),
+      sizeof (result->checksum));
+
+  g_checksum_free (checksum);
+  gst_buffer_unref (outbuf);
+  gst_object_unref (filter);
+}
+
+/* lines of "<clip> <field>=<value>", the values keyed by clip, lines
+ * starting with # are comments. Returns NULL when the file can't be read,
+ * with missing set when it doesn't exist */
+static GHashTable *
+bench_read_golden (const gchar * filename, const gchar * field,
+    gboolean * missing)
+{
+  GHashTable *golden;
+  gchar *contents, **lines, **line;
+  gchar *key = g_strdup_printf (" %s=", field);
+  GError *error = NULL;
+
+  if (!g_file_get_contents (filename, &contents, NULL, &error)) {
+    if (missing != NULL)
+      *missing = g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT);
+    else
+      g_printerr ("can't read %s: %s\n", filename, error->message);
+    g_error_free (error);
+    g_free (key);
+    return NULL;
+  }
+
+  golden = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
+  lines = g_strsplit (contents, "\n", -1);
+  for (line = lines; *line != NULL; line++) {
+    gchar *fields = strstr (*line, key);
+    gchar *value;
+
+    if (**line == '#' || fields == NULL)
+      continue;
+
+    value = fields + strlen (key);
+    g_hash_table_insert (golden, g_strndup (*line, fields - *line),
+        g_strndup (value, strcspn (value, " \t\r")));
+  }
+  g_strfreev (lines);
+  g_free (contents);
+  g_free (key);
+
+  return golden;
+}
+
+static gboolean
+bench_write_golden (const gchar * filename, GString * contents)
+{
+  GError *error = NULL;
+
+  if (!g_file_set_contents (filename, contents->str, contents->len, &error)) {
+    g_printerr ("can't write %s: %s\n", filename, error->message);
+    g_error_free (error);
+    return FALSE;
+  }
+
+  return TRUE;
+}
+
+/* expands a row of glyphs one pixel at a time like aatv did before the
+ * span table and the vector kernels, every RGBA kernel has to match it */
+static void
+bench_expand_reference (guint32 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette)
+{
+  guint x, font_x;
+
+  for (x = 0; x < n_cells; x++)
+    for (font_x = 0; font_x < 8; font_x++)
+      *dest++ = (glyphs[x] & (1 << font_x)) ?
+          palette->colors[classes[x]] : palette->background;
+}
+
+/* runs every RGBA kernel this CPU supports on random rows of every length
+ * up to a few vectors, at an aligned and an unaligned destination, with
+ * and without streaming stores, and compares them with the reference. Needs no golden file, returns the
+ * number of failures */
+static gint
+bench_check_kernels (void)
+{
+  GstAATvPalette palette = { {0}, };
+  GRand *rng = g_rand_new_with_seed (1);
+  guint8 glyphs[67], classes[67];
+  guint32 *expected, *out;
+  GstAATvRowFunc func;
+  const gchar *name;
+  gint failures = 0;
+  guint i, n, offset;
+
+  for (i = 0; i < GST_AATV_N_CLASSES; i++)
+    palette.colors[i] = g_rand_int (rng);
+  palette.background = g_rand_int (rng);
+  palette.format = GST_VIDEO_FORMAT_RGBA;
+  gst_aatv_palette_update (&palette);
+
+  expected = g_new (guint32, G_N_ELEMENTS (glyphs) * 8);
+  /* one spare pixel for the unaligned destination */
+  out = g_malloc (G_N_ELEMENTS (glyphs) * 8 * 4 + 4);
+
+  for (i = 0; gst_aatv_render_get_kernel (i, &name, &func); i++) {
+    gboolean ok = TRUE;
+
+    if (func == NULL) {
+      g_print ("check=unsupported kernel=%s\n", name);
+      continue;
+    }
+
+    for (n = 1; n <= G_N_ELEMENTS (glyphs) && ok; n++) {
+      guint j;
+
+      for (j = 0; j < n; j++) {
+        glyphs[j] = g_rand_int (rng);
+        classes[j] = g_rand_int_range (rng, 0, GST_AATV_N_CLASSES);
+      }
+      bench_expand_reference (expected, glyphs, classes, n, &palette);
+
+      /* with and without streaming stores */
+      for (offset = 0; offset < 4 * 4; offset += 4) {
+        guint8 *dest = (guint8 *) out + (offset & 4);
+
+        memset (out, 0, n * 8 * 4 + 4);
+        func (dest, glyphs, classes, n, &palette, offset >= 8);
+        if (memcmp (dest, expected, n * 8 * 4) != 0)
+          ok = FALSE;
+      }
+    }
+
+    if (!ok)
+      failures++;
+    g_print ("check=%s kernel=%s\n", ok ? "ok" : "mismatch", name);
+  }
+
+  g_free (out);
+  g_free (expected);
+  gst_aatv_palette_free (&palette);
+  g_rand_free (rng);
+
+  return failures;
+}
+
+/* compares every clip against the golden checksums in check and, when
+ * given and present, the frame times in times. With update or update_times
+ * it writes those files instead. Returns the exit status */
+static gint
+bench_check (const gchar * check, const gchar * times, const gchar * update,
+    const gchar * update_times, gdouble max_slowdown)
+{
+  static const gint inputs[][2] = {
+    {352, 288}, {640, 480},
+  };
+  /* an odd canvas catches edge cases in the chroma planes */
+  static const gint canvases[][2] = {
+    {80, 24}, {53, 17},
+  };
+  static const GstVideoFormat formats[] = {
+    GST_VIDEO_FORMAT_RGBA, GST_VIDEO_FORMAT_GRAY8, GST_VIDEO_FORMAT_RGB16,
+    GST_VIDEO_FORMAT_I420, GST_VIDEO_FORMAT_NV12, GST_VIDEO_FORMAT_UNKNOWN,
+  };
+  static const GstRainMode rain_modes[] = { GST_RAIN_OFF, GST_RAIN_DOWN };
+  gboolean writing = update != NULL || update_times != NULL;
+  GHashTable *golden = NULL, *golden_times = NULL;
+  GString *out = g_string_new (NULL), *out_times = g_string_new (NULL);
+  gint failures = 0, font, dither;
+  guint i, j, k, f;
+
+  /* a golden file is only as good as the kernel it was written with */
+  if (update != NULL && bench_check_kernels () > 0) {
+    g_printerr ("kernels don't match the reference, not writing %s\n",
+        update);
+    return 1;
+  }
+
+  if (!writing) {
+    if ((golden = bench_read_golden (check, "checksum", NULL)) == NULL)
+      return 1;
+    /* the kernels are checked against the reference either way, the clips
+     * only once there are checksums to compare them with */
+    if (g_hash_table_size (golden) == 0) {
+      g_print ("no checksums in %s yet, only checking the kernels, write "
+          "them with make bench-golden\n", check);
+      g_hash_table_unref (golden);
+      golden = NULL;
+    }
+    failures += bench_check_kernels ();
+
+    if (times != NULL && max_slowdown > 0) {
+      gboolean missing = FALSE;
+
+      golden_times = bench_read_golden (times, "ns_per_frame", &missing);
+      if (golden_times == NULL && missing)
+        g_print ("no %s, not comparing frame times\n", times);
+      else if (golden_times == NULL)
+        failures++;
+    }
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++)
+    for (j = 0; j < G_N_ELEMENTS (canvases); j++)
+      for (font = 0; font < 2 && aa_fonts[font] != NULL; font++)
+        for (dither = 0; aa_dithernames[dither] != NULL; dither++)
+          for (k = 0; k < G_N_ELEMENTS (rain_modes); k++)
+            for (f = 0; f < G_N_ELEMENTS (formats); f++) {
+              BenchResult result;
+              const gchar *status = "ok", *expected, *expected_time = NULL;
+              guint64 golden_ns = 0;
+              gchar *clip;
+
+              clip = g_strdup_printf ("src=%dx%d canvas=%dx%d font=%s "
+                  "dither=%s rain=%s format=%s", inputs[i][0], inputs[i][1],
+                  canvases[j][0], canvases[j][1], aa_fonts[font]->shortname,
+                  aa_dithernames[dither], rain_names[rain_modes[k]],
+                  bench_format_name (formats[f]));
+
+              bench_check_clip (inputs[i][0], inputs[i][1], canvases[j][0],
+                  canvases[j][1], font, dither, rain_modes[k], formats[f],
+                  &result);
+
+              if (writing) {
+                g_string_append_printf (out, "%s checksum=%s\n", clip,
+                    result.checksum);
+                g_string_append_printf (out_times, "%s ns_per_frame=%"
+                    G_GUINT64_FORMAT "\n", clip, result.ns_per_frame);
+                g_free (clip);
+                continue;
+              }
+
+              if (golden == NULL) {
+                g_print ("check=unchecked %s checksum=%s ns_per_frame=%"
+                    G_GUINT64_FORMAT "\n", clip, result.checksum,
+                    result.ns_per_frame);
+                g_free (clip);
+                continue;
+              }
+
+              expected = g_hash_table_lookup (golden, clip);
+              if (golden_times != NULL &&
+                  (expected_time = g_hash_table_lookup (golden_times,
+                          clip)) != NULL)
+                golden_ns = g_ascii_strtoull (expected_time, NULL, 10);
+
+              if (expected == NULL)
+                status = "missing";
+              else if (strcmp (expected, result.checksum) != 0)
+                status = "mismatch";
+              else if (golden_ns > 0 && result.ns_per_frame > golden_ns *
+                  (1.0 + max_slowdown / 100.0))
+                status = "slow";
+
+              if (strcmp (status, "ok") != 0)
+                failures++;
+
+              g_print ("check=%s %s checksum=%s ns_per_frame=%"
+                  G_GUINT64_FORMAT " golden_ns_per_frame=%" G_GUINT64_FORMAT
+                  "\n", status, clip, result.checksum, result.ns_per_frame,
+                  golden_ns);
+
+              g_free (clip);
+            }
+
+  if (update != NULL) {
+    g_string_prepend (out, "# aabench --check checksums, regenerate with "
+        "make bench-golden (scalar kernel)\n");
+    if (!bench_write_golden (update, out))
+      failures++;
+  }
+  if (update_times != NULL && !bench_write_golden (update_times, out_times))
+    failures++;
+
+  if (golden != NULL)
+    g_hash_table_unref (golden);
+  if (golden_times != NULL)
+    g_hash_table_unref (golden_times);
+  g_string_free (out, TRUE);
+  g_string_free (out_times, TRUE);
+
+  return failures > 0 ? 1 : 0;
+}
+
+int
+main (int argc, char **argv)
+{
+  static const gint inputs[][2] = {
+    {640, 480}, {1280, 720}, {1920, 1080},
+  };
+  static const gint canvases[][2] = {
+    {80, 24}, {160, 48},
+  };
+  static const GstRainMode rain_modes[] = { GST_RAIN_OFF, GST_RAIN_DOWN };
+  gint iterations = 200;
+  gchar *check = NULL, *update = NULL, *times = NULL, *update_times = NULL;
+  gdouble max_slowdown = 25.0;
+  GOptionEntry entries[] = {
+    {"check", 0, 0, G_OPTION_ARG_FILENAME, &check,
+        "Compare output checksums against a golden file", "FILE"},
+    {"update", 0, 0, G_OPTION_ARG_FILENAME, &update,
+        "Write a golden file from this build", "FILE"},
+    {"times", 0, 0, G_OPTION_ARG_FILENAME, &times,
+        "Also compare frame times with this file when it exists", "FILE"},
+    {"update-times", 0, 0, G_OPTION_ARG_FILENAME, &update_times,
+        "Write the frame times of this machine", "FILE"},
+    {"max-slowdown", 0, 0, G_OPTION_ARG_DOUBLE, &max_slowdown,
+          "Percent a clip may be slower than the --times file before --check "
+          "fails (0 = don't compare times, default 25)", "PERCENT"},
+    {NULL}
+  };
+  GOptionContext *context;
+  GError *error = NULL;
+  gint font, dither;
+  guint i, j, k;
+
+  context = g_option_context_new ("[ITERATIONS] - benchmark the aalib "
+      "elements");
+  g_option_context_add_main_entries (context, entries, NULL);
+  g_option_context_add_group (context, gst_init_get_option_group ());
+  if (!g_option_context_parse (context, &argc, &argv, &error)) {
+    g_printerr ("%s\n", error->message);
+    return 2;
+  }
+  g_option_context_free (context);
+
+  if (check != NULL || update != NULL || update_times != NULL)
+    return bench_check (check, times, update, update_times, max_slowdown);
+
+  if (argc > 1)
+    iterations = atoi (argv[1]);
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++)
+    for (j = 0; j < G_N_ELEMENTS (canvases); j++)
+      /* the aalib image has 2x2 pixels per character */
+      bench_scalers (inputs[i][0], inputs[i][1], canvases[j][0] * 2,
+          canvases[j][1] * 2, iterations);
+
+  for (i = 0; i < G_N_ELEMENTS (inputs); i++)
+    for (j = 0; j < G_N_ELEMENTS (canvases); j++)
+      for (font = 0; aa_fonts[font] != NULL; font++)
+        for (dither = 0; aa_dithernames[dither] != NULL; dither++)
+          for (k = 0; k < G_N_ELEMENTS (rain_modes); k++)
+            bench_aatv (inputs[i][0], inputs[i][1], canvases[j][0],
+                canvases[j][1], font, dither, rain_modes[k], iterations);
+
+  return 0;
+}
@@ -0,0 +1,715 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Area averaging luma downscaler shared by aasink and aatv.
+ *
+ * Every destination pixel is the average of the source area it covers,
+ * including the partially covered pixels on its edges. The filter is
+ * separable: a vertical pass blends the covered source rows into one row of
+ * 16 bit sums, a horizontal pass blends the covered sums of that row into
+ * the destination pixel. Weights are 7 bit fixed point and add up to
+ * GST_AA_SCALE_ONE per pass, which keeps the row sums inside a signed 16 bit
+ * lane for the SIMD multiply-adds. The tap tables only depend on the source
+ * and destination sizes and are rebuilt when those change.
+ *
+ * Sources other than a plain luma plane first have the luma of the rows a
+ * destination row covers extracted into a scratch buffer: every other byte
+ * for packed YUV and a weighted sum of R, G and B for RGB, which gives the
+ * same studio range luma videoconvert would produce.
+ *
+ * Brightness, contrast, gamma and inversion are folded into a 256 entry tone
+ * table that is applied while the destination pixels are written, aalib then
+ * gets neutral values for those. That only spares aa_renderpalette() working
+ * them into its palette, with pow() for gamma, on every call: it still looks
+ * every pixel up in that palette.
+ *
+ * For automatic exposure the tone can be deferred until the brightness has
+ * been picked from a histogram of the destination pixels, which the same
+ * pass counts only then. Applying the tone afterwards only touches the
+ * small destination image again.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstaascale.h"
+#include <string.h>
+#include <math.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GST_AA_SCALE_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GST_AA_SCALE_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define GST_AA_SCALE_SHIFT	7
+#define GST_AA_SCALE_ONE	(1 << GST_AA_SCALE_SHIFT)
+
+/* horizontal taps are padded to a multiple of this */
+#define GST_AA_SCALE_TAP_ALIGN	8
+
+/* BT.601 studio range luma from 8 bit RGB, weights in 1/256 */
+#define GST_AA_SCALE_Y_R	66
+#define GST_AA_SCALE_Y_G	129
+#define GST_AA_SCALE_Y_B	25
+
+typedef void (*GstAAScaleExtractFunc) (guint8 * dest, const guint8 * src,
+    const gint * offsets, gint pstride, gint width);
+
+struct _GstAAScaler
+{
+  gint sw, sh, dw, dh;
+
+  /* vertical taps: first source row, number of source rows and weights of
+   * every destination row */
+  gint *y_start;
+  gint *y_count;
+  gint y_taps;
+  gint16 *y_weights;
+
+  /* horizontal taps: first source column and weights of every destination
+   * column, padded with zero weights */
+  gint *x_start;
+  gint x_taps;
+  gint16 *x_weights;
+
+  /* one row of vertical sums, with room for the padded taps past the end */
+  gint16 *row;
+
+  /* source layout: bytes per pixel and offset of the luma byte, or of the
+   * R, G and B bytes, and the kernel extracting it. extract is NULL when
+   * the source is a plain luma plane. */
+  GstVideoFormat format;
+  gint pstride;
+  gint offsets[3];
+  GstAAScaleExtractFunc extract;
+  /* extracted luma of the source rows of one destination row */
+  guint8 *luma;
+
+  /* tone mapping applied to every destination pixel, unless the tone is
+   * deferred */
+  guint8 tone[256];
+  gboolean defer_tone;
+  /* contrast, gamma and inversion part of the tone, indexed after the
+   * brightness offset, and the values it was built for */
+  guint8 tone_curve[256];
+  gint bright, contrast, inversion;
+  gfloat gamma;
+
+  /* destination pixels of the last image scaled with the tone deferred, by
+   * their value before the tone */
+  guint32 histogram[256];
+  guint32 n_pixels;
+
+  gboolean use_sse2;
+};
+
+/* computes the taps mapping src_len source pixels onto dest_len destination
+ * pixels. Weights are rounded from the running coverage so that every set
+ * adds up to exactly GST_AA_SCALE_ONE without any weight going negative. */
+static gint16 *
+gst_aa_scaler_make_taps (gint src_len, gint dest_len, gint ** start,
+    gint ** count, gint * n_taps, gint tap_align)
+{
+  gint16 *weights;
+  gint taps, d, i;
+
+  /* one destination pixel covers src_len / dest_len source pixels, plus up
+   * to one partial pixel on each side */
+  taps = (src_len + dest_len - 1) / dest_len + 1;
+  taps = (taps + tap_align - 1) / tap_align * tap_align;
+
+  *start = g_new (gint, dest_len);
+  if (count)
+    *count = g_new (gint, dest_len);
+  *n_taps = taps;
+  weights = g_new0 (gint16, dest_len * taps);
+
+  for (d = 0; d < dest_len; d++) {
+    /* positions are in units of 1 / dest_len source pixels */
+    gint64 begin = (gint64) d * src_len;
+    gint64 end = begin + src_len;
+    gint first = begin / dest_len;
+    gint16 *w = weights + d * taps;
+    gint64 covered = 0;
+    gint prev = 0, n = 0;
+
+    for (i = 0; i < taps && first + i < src_len; i++) {
+      gint64 pix_begin = (gint64) (first + i) * dest_len;
+      gint64 pix_end = pix_begin + dest_len;
+      gint64 overlap = MIN (end, pix_end) - MAX (begin, pix_begin);
+      gint cur;
+
+      if (overlap <= 0)
+        break;
+      covered += overlap;
+      cur = (covered * GST_AA_SCALE_ONE + src_len / 2) / src_len;
+
+      w[n++] = cur - prev;
+      prev = cur;
+    }
+
+    (*start)[d] = first;
+    if (count)
+      (*count)[d] = n;
+  }
+
+  return weights;
+}
+
+static void
+gst_aa_scaler_clear (GstAAScaler * scaler)
+{
+  g_free (scaler->y_start);
+  g_free (scaler->y_count);
+  g_free (scaler->y_weights);
+  g_free (scaler->x_start);
+  g_free (scaler->x_weights);
+  g_free (scaler->row);
+  g_free (scaler->luma);
+  scaler->luma = NULL;
+  scaler->y_start = scaler->x_start = NULL;
+  scaler->y_count = NULL;
+  scaler->y_weights = scaler->x_weights = scaler->row = NULL;
+}
+
+static void
+gst_aa_scaler_setup (GstAAScaler * scaler, gint sw, gint sh, gint dw,
+    gint dh)
+{
+  gst_aa_scaler_clear (scaler);
+
+  scaler->sw = sw;
+  scaler->sh = sh;
+  scaler->dw = dw;
+  scaler->dh = dh;
+
+  scaler->y_weights = gst_aa_scaler_make_taps (sh, dh, &scaler->y_start,
+      &scaler->y_count, &scaler->y_taps, 1);
+  scaler->x_weights = gst_aa_scaler_make_taps (sw, dw, &scaler->x_start,
+      NULL, &scaler->x_taps, GST_AA_SCALE_TAP_ALIGN);
+  scaler->row = g_new0 (gint16, sw + scaler->x_taps);
+  scaler->luma = g_new (guint8, (gsize) sw * scaler->y_taps);
+}
+
+GstAAScaler *
+gst_aa_scaler_new (void)
+{
+  GstAAScaler *scaler = g_new0 (GstAAScaler, 1);
+  gint i;
+
+  for (i = 0; i < 256; i++)
+    scaler->tone[i] = scaler->tone_curve[i] = i;
+  scaler->gamma = 1.0;
+  scaler->format = GST_VIDEO_FORMAT_GRAY8;
+  scaler->pstride = 1;
+
+#ifdef GST_AA_SCALE_HAVE_X86
+  scaler->use_sse2 = __builtin_cpu_supports ("sse2");
+#endif
+
+  return scaler;
+}
+
+void
+gst_aa_scaler_free (GstAAScaler * scaler)
+{
+  gst_aa_scaler_clear (scaler);
+  g_free (scaler);
+}
+
+static void
+gst_aa_scaler_extract_luma_c (guint8 * dest, const guint8 * src,
+    const gint * offsets, gint pstride, gint width)
+{
+  gint x;
+
+  src += offsets[0];
+  for (x = 0; x < width; x++)
+    dest[x] = src[x * pstride];
+}
+
+static void
+gst_aa_scaler_extract_rgb_c (guint8 * dest, const guint8 * src,
+    const gint * offsets, gint pstride, gint width)
+{
+  const guint8 *r = src + offsets[0];
+  const guint8 *g = src + offsets[1];
+  const guint8 *b = src + offsets[2];
+  gint x;
+
+  for (x = 0; x < width; x++) {
+    gint i = x * pstride;
+
+    dest[x] = ((GST_AA_SCALE_Y_R * r[i] + GST_AA_SCALE_Y_G * g[i] +
+            GST_AA_SCALE_Y_B * b[i] + 128) >> 8) + 16;
+  }
+}
+
+static void
+gst_aa_scaler_vertical_c (gint16 * row, const guint8 * src, gint ss,
+    const gint16 * weights, gint n_taps, gint width)
+{
+  gint x, t;
+
+  for (x = 0; x < width; x++)
+    row[x] = weights[0] * src[x];
+  for (t = 1; t < n_taps; t++) {
+    const guint8 *line = src + t * ss;
+
+    for (x = 0; x < width; x++)
+      row[x] += weights[t] * line[x];
+  }
+}
+
+static void
+gst_aa_scaler_horizontal_c (guint8 * dest, const gint16 * row,
+    const gint * start, const gint16 * weights, gint n_taps,
+    const guint8 * tone, guint32 * histogram, gint width)
+{
+  gint x, t;
+
+  for (x = 0; x < width; x++) {
+    const gint16 *taps = row + start[x];
+    gint sum = 0;
+    guint8 luma;
+
+    for (t = 0; t < n_taps; t++)
+      sum += weights[t] * taps[t];
+    weights += n_taps;
+
+    luma = (sum + (1 << (2 * GST_AA_SCALE_SHIFT - 1)))
+        >> (2 * GST_AA_SCALE_SHIFT);
+    if (histogram != NULL) {
+      histogram[luma]++;
+      dest[x] = luma;
+    } else {
+      dest[x] = tone[luma];
+    }
+  }
+}
+
+#ifdef GST_AA_SCALE_HAVE_X86
+/* packed 4:2:2, pstride is 2 */
+__attribute__ ((target ("sse2")))
+static void
+gst_aa_scaler_extract_luma_sse2 (guint8 * dest, const guint8 * src,
+    const gint * offsets, gint pstride, gint width)
+{
+  const __m128i mask = _mm_set1_epi16 (0xff);
+  gint x;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i a = _mm_loadu_si128 ((const __m128i *) (src + 2 * x));
+    __m128i b = _mm_loadu_si128 ((const __m128i *) (src + 2 * x + 16));
+
+    if (offsets[0]) {
+      a = _mm_srli_epi16 (a, 8);
+      b = _mm_srli_epi16 (b, 8);
+    } else {
+      a = _mm_and_si128 (a, mask);
+      b = _mm_and_si128 (b, mask);
+    }
+    _mm_storeu_si128 ((__m128i *) (dest + x), _mm_packus_epi16 (a, b));
+  }
+
+  if (x < width)
+    gst_aa_scaler_extract_luma_c (dest + x, src + 2 * x, offsets, pstride,
+        width - x);
+}
+
+/* sums two 32 bit lanes per pixel into one lane per pixel */
+__attribute__ ((target ("sse2")))
+static inline __m128i
+gst_aa_scaler_rgb_sum_sse2 (__m128i pix, __m128i weights)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  __m128 lo = _mm_castsi128_ps (_mm_madd_epi16 (_mm_unpacklo_epi8 (pix,
+              zero), weights));
+  __m128 hi = _mm_castsi128_ps (_mm_madd_epi16 (_mm_unpackhi_epi8 (pix,
+              zero), weights));
+
+  return _mm_add_epi32 (_mm_castps_si128 (_mm_shuffle_ps (lo, hi,
+              _MM_SHUFFLE (2, 0, 2, 0))),
+      _mm_castps_si128 (_mm_shuffle_ps (lo, hi, _MM_SHUFFLE (3, 1, 3, 1))));
+}
+
+/* 32 bit RGB, pstride is 4 */
+__attribute__ ((target ("sse2")))
+static void
+gst_aa_scaler_extract_rgb_sse2 (guint8 * dest, const guint8 * src,
+    const gint * offsets, gint pstride, gint width)
+{
+  const __m128i round = _mm_set1_epi32 (128 + (16 << 8));
+  gint16 w[4] = { 0, 0, 0, 0 };
+  __m128i weights;
+  gint x;
+
+  w[offsets[0]] = GST_AA_SCALE_Y_R;
+  w[offsets[1]] = GST_AA_SCALE_Y_G;
+  w[offsets[2]] = GST_AA_SCALE_Y_B;
+  weights = _mm_setr_epi16 (w[0], w[1], w[2], w[3], w[0], w[1], w[2], w[3]);
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    const __m128i *p = (const __m128i *) (src + 4 * x);
+    __m128i y0, y1, y2, y3;
+
+    y0 = gst_aa_scaler_rgb_sum_sse2 (_mm_loadu_si128 (p), weights);
+    y1 = gst_aa_scaler_rgb_sum_sse2 (_mm_loadu_si128 (p + 1), weights);
+    y2 = gst_aa_scaler_rgb_sum_sse2 (_mm_loadu_si128 (p + 2), weights);
+    y3 = gst_aa_scaler_rgb_sum_sse2 (_mm_loadu_si128 (p + 3), weights);
+    y0 = _mm_srli_epi32 (_mm_add_epi32 (y0, round), 8);
+    y1 = _mm_srli_epi32 (_mm_add_epi32 (y1, round), 8);
+    y2 = _mm_srli_epi32 (_mm_add_epi32 (y2, round), 8);
+    y3 = _mm_srli_epi32 (_mm_add_epi32 (y3, round), 8);
+
+    _mm_storeu_si128 ((__m128i *) (dest + x),
+        _mm_packus_epi16 (_mm_packs_epi32 (y0, y1), _mm_packs_epi32 (y2,
+                y3)));
+  }
+
+  if (x < width)
+    gst_aa_scaler_extract_rgb_c (dest + x, src + 4 * x, offsets, pstride,
+        width - x);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+gst_aa_scaler_vertical_sse2 (gint16 * row, const guint8 * src, gint ss,
+    const gint16 * weights, gint n_taps, gint width)
+{
+  const __m128i zero = _mm_setzero_si128 ();
+  gint x, t;
+
+  for (x = 0; x + 16 <= width; x += 16) {
+    __m128i lo = _mm_setzero_si128 ();
+    __m128i hi = _mm_setzero_si128 ();
+
+    for (t = 0; t < n_taps; t++) {
+      __m128i w = _mm_set1_epi16 (weights[t]);
+      __m128i pix = _mm_loadu_si128 ((const __m128i *) (src + t * ss + x));
+
+      lo = _mm_add_epi16 (lo, _mm_mullo_epi16 (_mm_unpacklo_epi8 (pix, zero),
+              w));
+      hi = _mm_add_epi16 (hi, _mm_mullo_epi16 (_mm_unpackhi_epi8 (pix, zero),
+              w));
+    }
+    _mm_storeu_si128 ((__m128i *) (row + x), lo);
+    _mm_storeu_si128 ((__m128i *) (row + x + 8), hi);
+  }
+
+  if (x < width)
+    gst_aa_scaler_vertical_c (row + x, src + x, ss, weights, n_taps,
+        width - x);
+}
+
+__attribute__ ((target ("sse2")))
+static void
+gst_aa_scaler_horizontal_sse2 (guint8 * dest, const gint16 * row,
+    const gint * start, const gint16 * weights, gint n_taps,
+    const guint8 * tone, guint32 * histogram, gint width)
+{
+  gint x, t;
+
+  for (x = 0; x < width; x++) {
+    const gint16 *taps = row + start[x];
+    __m128i sum = _mm_setzero_si128 ();
+    gint total;
+    guint8 luma;
+
+    /* n_taps is a multiple of 8 */
+    for (t = 0; t < n_taps; t += 8)
+      sum = _mm_add_epi32 (sum,
+          _mm_madd_epi16 (_mm_loadu_si128 ((const __m128i *) (taps + t)),
+              _mm_loadu_si128 ((const __m128i *) (weights + t))));
+    weights += n_taps;
+
+    sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE (1, 0, 3,
+                2)));
+    sum = _mm_add_epi32 (sum, _mm_shuffle_epi32 (sum, _MM_SHUFFLE (2, 3, 0,
+                1)));
+    total = _mm_cvtsi128_si32 (sum);
+
+    luma = (total + (1 << (2 * GST_AA_SCALE_SHIFT - 1)))
+        >> (2 * GST_AA_SCALE_SHIFT);
+    if (histogram != NULL) {
+      histogram[luma]++;
+      dest[x] = luma;
+    } else {
+      dest[x] = tone[luma];
+    }
+  }
+}
+#endif
+
+#ifdef GST_AA_SCALE_HAVE_NEON
+static void
+gst_aa_scaler_vertical_neon (gint16 * row, const guint8 * src, gint ss,
+    const gint16 * weights, gint n_taps, gint width)
+{
+  gint x, t;
+
+  for (x = 0; x + 8 <= width; x += 8) {
+    uint16x8_t sum = vdupq_n_u16 (0);
+
+    for (t = 0; t < n_taps; t++)
+      sum = vmlaq_n_u16 (sum, vmovl_u8 (vld1_u8 (src + t * ss + x)),
+          weights[t]);
+    vst1q_s16 (row + x, vreinterpretq_s16_u16 (sum));
+  }
+
+  if (x < width)
+    gst_aa_scaler_vertical_c (row + x, src + x, ss, weights, n_taps,
+        width - x);
+}
+#endif
+
+static void
+gst_aa_scaler_set_rgb (GstAAScaler * scaler, gint pstride, gint r, gint g,
+    gint b)
+{
+  scaler->pstride = pstride;
+  scaler->offsets[0] = r;
+  scaler->offsets[1] = g;
+  scaler->offsets[2] = b;
+  scaler->extract = gst_aa_scaler_extract_rgb_c;
+#ifdef GST_AA_SCALE_HAVE_X86
+  if (scaler->use_sse2 && pstride == 4)
+    scaler->extract = gst_aa_scaler_extract_rgb_sse2;
+#endif
+}
+
+/* selects how the luma is read from the source, returns FALSE for formats
+ * the scaler can't read */
+gboolean
+gst_aa_scaler_set_format (GstAAScaler * scaler, GstVideoFormat format)
+{
+  if (format == scaler->format)
+    return TRUE;
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_YV12:
+    case GST_VIDEO_FORMAT_NV12:
+    case GST_VIDEO_FORMAT_NV21:
+    case GST_VIDEO_FORMAT_Y42B:
+    case GST_VIDEO_FORMAT_Y444:
+    case GST_VIDEO_FORMAT_GRAY8:
+      scaler->pstride = 1;
+      scaler->offsets[0] = 0;
+      scaler->extract = NULL;
+      break;
+    case GST_VIDEO_FORMAT_YUY2:
+    case GST_VIDEO_FORMAT_YVYU:
+    case GST_VIDEO_FORMAT_UYVY:
+      scaler->pstride = 2;
+      scaler->offsets[0] = format == GST_VIDEO_FORMAT_UYVY ? 1 : 0;
+      scaler->extract = gst_aa_scaler_extract_luma_c;
+#ifdef GST_AA_SCALE_HAVE_X86
+      if (scaler->use_sse2)
+        scaler->extract = gst_aa_scaler_extract_luma_sse2;
+#endif
+      break;
+    case GST_VIDEO_FORMAT_RGBx:
+    case GST_VIDEO_FORMAT_RGBA:
+      gst_aa_scaler_set_rgb (scaler, 4, 0, 1, 2);
+      break;
+    case GST_VIDEO_FORMAT_BGRx:
+    case GST_VIDEO_FORMAT_BGRA:
+      gst_aa_scaler_set_rgb (scaler, 4, 2, 1, 0);
+      break;
+    case GST_VIDEO_FORMAT_xRGB:
+    case GST_VIDEO_FORMAT_ARGB:
+      gst_aa_scaler_set_rgb (scaler, 4, 1, 2, 3);
+      break;
+    case GST_VIDEO_FORMAT_xBGR:
+    case GST_VIDEO_FORMAT_ABGR:
+      gst_aa_scaler_set_rgb (scaler, 4, 3, 2, 1);
+      break;
+    case GST_VIDEO_FORMAT_RGB:
+      gst_aa_scaler_set_rgb (scaler, 3, 0, 1, 2);
+      break;
+    case GST_VIDEO_FORMAT_BGR:
+      gst_aa_scaler_set_rgb (scaler, 3, 2, 1, 0);
+      break;
+    default:
+      return FALSE;
+  }
+  scaler->format = format;
+
+  return TRUE;
+}
+
+/* scales the sw x sh image at src (ss bytes per line) into the tightly
+ * packed dw x dh luma plane at dest, src is the first plane of an image in
+ * the format given to gst_aa_scaler_set_format() */
+void
+gst_aa_scaler_scale (GstAAScaler * scaler, const guint8 * src, gint sw,
+    gint sh, gint ss, guint8 * dest, gint dw, gint dh)
+{
+  const guint8 *tone = scaler->tone;
+  guint32 *histogram;
+  gint y;
+
+  g_return_if_fail ((dw != 0) && (dh != 0));
+
+  if (scaler->sw != sw || scaler->sh != sh || scaler->dw != dw ||
+      scaler->dh != dh)
+    gst_aa_scaler_setup (scaler, sw, sh, dw, dh);
+
+  /* the histogram is only needed to pick the deferred tone */
+  histogram = NULL;
+  scaler->n_pixels = 0;
+  if (scaler->defer_tone) {
+    histogram = scaler->histogram;
+    memset (histogram, 0, sizeof (scaler->histogram));
+    scaler->n_pixels = dw * dh;
+  }
+
+  for (y = 0; y < dh; y++) {
+    const guint8 *line = src + (gsize) scaler->y_start[y] * ss;
+    const gint16 *y_weights = scaler->y_weights + y * scaler->y_taps;
+    gint n_taps = scaler->y_count[y];
+    gint line_stride = ss;
+
+    if (scaler->extract) {
+      gint t;
+
+      for (t = 0; t < n_taps; t++)
+        scaler->extract (scaler->luma + t * sw, line + t * ss,
+            scaler->offsets, scaler->pstride, sw);
+      line = scaler->luma;
+      line_stride = sw;
+    }
+
+#if defined(GST_AA_SCALE_HAVE_X86)
+    if (scaler->use_sse2) {
+      gst_aa_scaler_vertical_sse2 (scaler->row, line, line_stride, y_weights,
+          n_taps, sw);
+      gst_aa_scaler_horizontal_sse2 (dest, scaler->row, scaler->x_start,
+          scaler->x_weights, scaler->x_taps, tone, histogram, dw);
+      dest += dw;
+      continue;
+    }
+#elif defined(GST_AA_SCALE_HAVE_NEON)
+    gst_aa_scaler_vertical_neon (scaler->row, line, line_stride, y_weights,
+        n_taps, sw);
+    gst_aa_scaler_horizontal_c (dest, scaler->row, scaler->x_start,
+        scaler->x_weights, scaler->x_taps, tone, histogram, dw);
+    dest += dw;
+    continue;
+#endif
+
+    gst_aa_scaler_vertical_c (scaler->row, line, line_stride, y_weights,
+        n_taps, sw);
+    gst_aa_scaler_horizontal_c (dest, scaler->row, scaler->x_start,
+        scaler->x_weights, scaler->x_taps, tone, histogram, dw);
+    dest += dw;
+  }
+}
+
+/* same steps aa_renderpalette() takes, see aarender.c in aalib */
+#define DO_CONTRAST(i,c) (((i)<(c))?0:(((i)>(255-(c)))?255:((i)-(c))*255/(255-2*(c))))
+
+/* applies the tone part of params to every following scaled image, and
+ * returns the params to render the image with instead */
+void
+gst_aa_scaler_set_tone (GstAAScaler * scaler,
+    const struct aa_renderparams *params,
+    struct aa_renderparams *render_params)
+{
+  gint i, y;
+
+  if (params->contrast != scaler->contrast ||
+      params->gamma != scaler->gamma ||
+      params->inversion != scaler->inversion) {
+    for (i = 0; i < 256; i++) {
+      y = i;
+      if (params->contrast)
+        y = DO_CONTRAST (y, params->contrast);
+      if (params->gamma != 1.0)
+        y = pow (y / 255.0, params->gamma) * 255 + 0.5;
+      if (params->inversion)
+        y = 255 - y;
+      scaler->tone_curve[i] = CLAMP (y, 0, 255);
+    }
+    scaler->contrast = params->contrast;
+    scaler->gamma = params->gamma;
+    scaler->inversion = params->inversion;
+    /* force the brightness offset to be applied again */
+    scaler->bright = params->bright + 1;
+  }
+
+  /* auto-brightness changes this every frame, it is only an offset into
+   * the curve */
+  if (params->bright != scaler->bright) {
+    for (i = 0; i < 256; i++)
+      scaler->tone[i] = scaler->tone_curve[CLAMP (i + params->bright, 0, 255)];
+    scaler->bright = params->bright;
+  }
+
+  *render_params = *params;
+  render_params->bright = 0;
+  render_params->contrast = 0;
+  render_params->gamma = 1.0;
+  render_params->inversion = 0;
+}
+
+/* while defer is set, gst_aa_scaler_scale() leaves the tone to
+ * gst_aa_scaler_apply_tone() and counts the histogram the brightness can be
+ * picked from with gst_aa_scaler_get_level() */
+void
+gst_aa_scaler_set_defer_tone (GstAAScaler * scaler, gboolean defer)
+{
+  scaler->defer_tone = defer;
+}
+
+/* applies the current tone to n pixels scaled with the tone deferred */
+void
+gst_aa_scaler_apply_tone (GstAAScaler * scaler, guint8 * dest, gint n)
+{
+  gint i;
+
+  for (i = 0; i < n; i++)
+    dest[i] = scaler->tone[dest[i]];
+}
+
+/* mean of the last scaled image between 0 and 1 as it would come out with
+ * brightness bright and the current contrast, gamma and inversion */
+gfloat
+gst_aa_scaler_get_level (GstAAScaler * scaler, gint bright)
+{
+  guint64 sum = 0;
+  gint i;
+
+  if (scaler->n_pixels == 0)
+    return 0.0;
+
+  for (i = 0; i < 256; i++)
+    if (scaler->histogram[i])
+      sum += (guint64) scaler->histogram[i] *
+          scaler->tone_curve[CLAMP (i + bright, 0, 255)];
+
+  return sum / (255.0 * scaler->n_pixels);
+}
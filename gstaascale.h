@@ -0,0 +1,57 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __GST_AA_SCALE_H__
+#define __GST_AA_SCALE_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+#include <aalib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* formats gst_aa_scaler_set_format() accepts */
+#define GST_AA_SCALE_FORMATS "{ I420, YV12, NV12, NV21, Y42B, Y444, GRAY8, " \
+    "YUY2, YVYU, UYVY, RGBx, BGRx, xRGB, xBGR, RGBA, BGRA, ARGB, ABGR, " \
+    "RGB, BGR }"
+
+typedef struct _GstAAScaler GstAAScaler;
+
+GstAAScaler *gst_aa_scaler_new (void);
+void gst_aa_scaler_free (GstAAScaler * scaler);
+gboolean gst_aa_scaler_set_format (GstAAScaler * scaler,
+    GstVideoFormat format);
+void gst_aa_scaler_scale (GstAAScaler * scaler, const guint8 * src,
+    gint sw, gint sh, gint ss, guint8 * dest, gint dw, gint dh);
+void gst_aa_scaler_set_tone (GstAAScaler * scaler,
+    const struct aa_renderparams * params,
+    struct aa_renderparams * render_params);
+void gst_aa_scaler_set_defer_tone (GstAAScaler * scaler, gboolean defer);
+void gst_aa_scaler_apply_tone (GstAAScaler * scaler, guint8 * dest, gint n);
+gfloat gst_aa_scaler_get_level (GstAAScaler * scaler, gint bright);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AA_SCALE_H__ */
@@ -42,8 +42,13 @@
 
 #include <gst/video/gstvideometa.h>
 #include "gstaasink.h"
+#include "gstaatracer.h"
 #include "gstaatv.h"
 
+/* while frames stay slower than the frame rate, repeat the QoS message
+ * at most this often */
+#define GST_AASINK_QOS_INTERVAL GST_SECOND
+
 /* aasink signals and args */
 enum
 {
@@ -64,13 +69,16 @@ enum
   PROP_INVERSION,
   PROP_RANDOMVAL,
   PROP_FRAMES_DISPLAYED,
-  PROP_FRAME_TIME
+  PROP_FRAME_TIME,
+  PROP_N_THREADS,
+  PROP_FRAMES_DROPPED,
+  PROP_STATS
 };
 
 static GstStaticPadTemplate sink_template = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("I420"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_AA_SCALE_FORMATS))
     );
 
 static GstCaps *gst_aasink_fixate (GstBaseSink * bsink, GstCaps * caps);
@@ -89,6 +97,8 @@ static void gst_aasink_get_property (GObject * object, guint prop_id,
 
 static GstStateChangeReturn gst_aasink_change_state (GstElement * element,
     GstStateChange transition);
+static gboolean gst_aasink_post_message (GstElement * element,
+    GstMessage * message);
 
 #define gst_aasink_parent_class parent_class
 G_DEFINE_TYPE (GstAASink, gst_aasink, GST_TYPE_VIDEO_SINK);
@@ -207,8 +217,25 @@ gst_aasink_class_init (GstAASinkClass * klass)
           "frames displayed", "frames displayed", G_MININT, G_MAXINT, 0,
           G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_FRAME_TIME,
-      g_param_spec_int ("frame-time", "frame time", "frame time", G_MININT,
-          G_MAXINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+      g_param_spec_int ("frame-time", "frame time",
+          "Milliseconds the last frame took to scale, convert and flush",
+          G_MININT, G_MAXINT, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "n-threads",
+          "Number of threads used to convert the image to characters "
+          "(0 = number of cores)", 0, GST_AA_TASK_RUNNER_MAX_THREADS, 0,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_FRAMES_DROPPED, g_param_spec_uint64 ("frames-dropped",
+          "frames dropped", "Frames dropped for being too late", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_STATS,
+      g_param_spec_boxed ("stats", "stats",
+          "Last, mean and 99th percentile time in nanoseconds of the scale, "
+          "match and flush stages, the whole frame and the latency from "
+          "buffer timestamp to flush, and a histogram of that latency",
+          GST_TYPE_STRUCTURE,
+          G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
 
   gst_element_class_add_static_pad_template (gstelement_class, &sink_template);
 
@@ -217,6 +244,8 @@ gst_aasink_class_init (GstAASinkClass * klass)
       "Wim Taymans <wim.taymans@chello.be>");
 
   gstelement_class->change_state = GST_DEBUG_FUNCPTR (gst_aasink_change_state);
+  gstelement_class->post_message =
+      GST_DEBUG_FUNCPTR (gst_aasink_post_message);
 
   gstbasesink_class->fixate = GST_DEBUG_FUNCPTR (gst_aasink_fixate);
   gstbasesink_class->set_caps = GST_DEBUG_FUNCPTR (gst_aasink_setcaps);
@@ -280,43 +309,7 @@ gst_aasink_init (GstAASink * aasink)
   aasink->ascii_parms.inversion = 0;
   aasink->ascii_parms.randomval = 0;
   aasink->aa_driver = 0;
-}
-
-static void
-gst_aasink_scale (GstAASink * aasink, guchar * src, guchar * dest,
-    gint sw, gint sh, gint ss, gint dw, gint dh)
-{
-  gint ypos, yinc, y;
-  gint xpos, xinc, x;
-
-  g_return_if_fail ((dw != 0) && (dh != 0));
-
-  ypos = 0x10000;
-  yinc = (sh << 16) / dh;
-  xinc = (sw << 16) / dw;
-
-  for (y = dh; y; y--) {
-    while (ypos > 0x10000) {
-      ypos -= 0x10000;
-      src += ss;
-    }
-    xpos = 0x10000;
-    {
-      guchar *destp = dest;
-      guchar *srcp = src;
-
-      for (x = dw; x; x--) {
-        while (xpos >= 0x10000L) {
-          srcp++;
-          xpos -= 0x10000L;
-        }
-        *destp++ = *srcp;
-        xpos += xinc;
-      }
-    }
-    dest += dw;
-    ypos += yinc;
-  }
+  aasink->n_threads = 0;
 }
 
 static void
@@ -366,11 +359,143 @@ invalid_caps:
   }
 }
 
+static const gchar *stage_names[GST_AASINK_N_STAGES] = {
+  "scale", "match", "flush", "frame"
+};
+
+/* called with the object lock held */
+static GstStructure *
+gst_aasink_get_stats (GstAASink * aasink)
+{
+  GstStructure *s;
+  guint i;
+
+  s = gst_structure_new ("aasink-stats",
+      "frames-displayed", G_TYPE_UINT64,
+      aasink->stats[GST_AASINK_STAGE_FRAME].count,
+      "frames-dropped", G_TYPE_UINT64, aasink->frames_dropped, NULL);
+
+  for (i = 0; i < GST_AASINK_N_STAGES; i++)
+    gst_aa_stats_set_fields (&aasink->stats[i], s, stage_names[i]);
+  gst_aa_stats_set_fields (&aasink->latency, s, "latency");
+  gst_aa_stats_set_histogram (&aasink->latency, s, "latency");
+
+  return s;
+}
+
+/* current running time, or GST_CLOCK_TIME_NONE without a clock */
+static GstClockTime
+gst_aasink_get_running_time (GstAASink * aasink)
+{
+  GstClock *clock;
+  GstClockTime now = GST_CLOCK_TIME_NONE;
+
+  clock = gst_element_get_clock (GST_ELEMENT (aasink));
+  if (clock != NULL) {
+    now = gst_clock_get_time (clock) -
+        gst_element_get_base_time (GST_ELEMENT (aasink));
+    gst_object_unref (clock);
+  }
+
+  return now;
+}
+
+/* records the stages of a shown frame and tells the application when the
+ * terminal falls behind the frame rate, and again once a QoS interval while
+ * it stays behind */
+static void
+gst_aasink_update_stats (GstAASink * aasink, GstBuffer * buffer,
+    GstClockTime * times)
+{
+  GstBaseSink *bsink = GST_BASE_SINK (aasink);
+  GstClockTime elapsed = times[GST_AASINK_STAGE_FRAME] - times[0];
+  GstClockTime duration = GST_BUFFER_DURATION (buffer);
+  GstClockTime running_time = GST_CLOCK_TIME_NONE;
+  GstClockTime now;
+  GstMessage *qos = NULL;
+  gboolean late;
+  guint i;
+
+  for (i = 0; i < GST_AASINK_N_STAGES - 1; i++)
+    gst_aa_trace_stage (GST_ELEMENT (aasink), stage_names[i], times[i],
+        times[i + 1]);
+
+  if (GST_BUFFER_PTS_IS_VALID (buffer))
+    running_time = gst_segment_to_running_time (&bsink->segment,
+        GST_FORMAT_TIME, GST_BUFFER_PTS (buffer));
+  now = gst_aasink_get_running_time (aasink);
+
+  if (!GST_CLOCK_TIME_IS_VALID (duration) &&
+      GST_VIDEO_INFO_FPS_N (&aasink->info) > 0)
+    duration = gst_util_uint64_scale_int (GST_SECOND,
+        GST_VIDEO_INFO_FPS_D (&aasink->info),
+        GST_VIDEO_INFO_FPS_N (&aasink->info));
+
+  GST_OBJECT_LOCK (aasink);
+
+  for (i = 0; i < GST_AASINK_N_STAGES - 1; i++)
+    gst_aa_stats_add (&aasink->stats[i], times[i + 1] - times[i]);
+  gst_aa_stats_add (&aasink->stats[GST_AASINK_STAGE_FRAME], elapsed);
+
+  if (GST_CLOCK_TIME_IS_VALID (running_time) && GST_CLOCK_TIME_IS_VALID (now))
+    gst_aa_stats_add (&aasink->latency,
+        now > running_time ? now - running_time : 0);
+
+  aasink->frames_displayed++;
+  aasink->frame_time = elapsed;
+
+  /* slower than the frame rate, upstream QoS only sees this once frames
+   * start to be dropped */
+  late = GST_CLOCK_TIME_IS_VALID (duration) && duration > 0 &&
+      elapsed > duration;
+  if (late && (!aasink->late ||
+          times[GST_AASINK_STAGE_FRAME] - aasink->qos_posted >=
+          GST_AASINK_QOS_INTERVAL)) {
+    aasink->qos_posted = times[GST_AASINK_STAGE_FRAME];
+    /* aasink isn't a live source, the frames come late however it syncs */
+    qos = gst_message_new_qos (GST_OBJECT (aasink), FALSE, running_time,
+        gst_segment_to_stream_time (&bsink->segment, GST_FORMAT_TIME,
+            GST_BUFFER_PTS (buffer)), GST_BUFFER_PTS (buffer), duration);
+    gst_message_set_qos_values (qos, (gint64) (elapsed - duration),
+        (gdouble) elapsed / duration, 1000000 * duration / elapsed);
+    gst_message_set_qos_stats (qos, GST_FORMAT_BUFFERS,
+        aasink->frames_displayed, aasink->frames_dropped);
+  }
+  aasink->late = late;
+
+  GST_OBJECT_UNLOCK (aasink);
+
+  if (qos != NULL)
+    gst_element_post_message (GST_ELEMENT (aasink), qos);
+}
+
+/* (re)create the worker pool when n-threads changed */
+static void
+gst_aasink_update_task_runner (GstAASink * aasink)
+{
+  guint n_threads;
+
+  GST_OBJECT_LOCK (aasink);
+  n_threads = gst_aa_task_runner_resolve_n_threads (aasink->n_threads);
+  GST_OBJECT_UNLOCK (aasink);
+
+  if (aasink->task_runner != NULL &&
+      gst_aa_task_runner_get_n_threads (aasink->task_runner) == n_threads)
+    return;
+
+  if (aasink->task_runner != NULL)
+    gst_aa_task_runner_free (aasink->task_runner);
+  aasink->task_runner = gst_aa_task_runner_new (n_threads);
+}
+
 static GstFlowReturn
 gst_aasink_show_frame (GstVideoSink * videosink, GstBuffer * buffer)
 {
   GstAASink *aasink;
   GstVideoFrame frame;
+  struct aa_renderparams render_parms;
+  /* the start of each stage, the frame slot holds the end of the flush */
+  GstClockTime times[GST_AASINK_N_STAGES];
 
   aasink = GST_AASINK (videosink);
 
@@ -379,20 +504,30 @@ gst_aasink_show_frame (GstVideoSink * videosink, GstBuffer * buffer)
   if (!gst_video_frame_map (&frame, &aasink->info, buffer, GST_MAP_READ))
     goto invalid_frame;
 
-  gst_aasink_scale (aasink, GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),     /* src */
-      aa_image (aasink->context),       /* dest */
+  gst_aasink_update_task_runner (aasink);
+
+  times[GST_AASINK_STAGE_SCALE] = gst_util_get_timestamp ();
+  gst_aa_scaler_set_tone (aasink->scaler, &aasink->ascii_parms,
+      &render_parms);
+  gst_aa_scaler_set_format (aasink->scaler, GST_VIDEO_FRAME_FORMAT (&frame));
+  gst_aa_scaler_scale (aasink->scaler, GST_VIDEO_FRAME_PLANE_DATA (&frame, 0),  /* src */
       GST_VIDEO_INFO_WIDTH (&aasink->info),     /* sw */
       GST_VIDEO_INFO_HEIGHT (&aasink->info),    /* sh */
       GST_VIDEO_FRAME_PLANE_STRIDE (&frame, 0), /* ss */
+      aa_image (aasink->context),       /* dest */
       aa_imgwidth (aasink->context),    /* dw */
       aa_imgheight (aasink->context));  /* dh */
 
-  aa_render (aasink->context, &aasink->ascii_parms,
-      0, 0, aa_imgwidth (aasink->context), aa_imgheight (aasink->context));
+  times[GST_AASINK_STAGE_MATCH] = gst_util_get_timestamp ();
+  gst_aa_render_bands (aasink->task_runner, aasink->context, &render_parms);
+  times[GST_AASINK_STAGE_FLUSH] = gst_util_get_timestamp ();
   aa_flush (aasink->context);
+  times[GST_AASINK_STAGE_FRAME] = gst_util_get_timestamp ();
   aa_getevent (aasink->context, FALSE);
   gst_video_frame_unmap (&frame);
 
+  gst_aasink_update_stats (aasink, buffer, times);
+
   return GST_FLOW_OK;
 
   /* ERRORS */
@@ -447,6 +582,12 @@ gst_aasink_set_property (GObject * object, guint prop_id, const GValue * value,
       aasink->ascii_parms.randomval = g_value_get_int (value);
       break;
     }
+    case PROP_N_THREADS:{
+      GST_OBJECT_LOCK (aasink);
+      aasink->n_threads = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (aasink);
+      break;
+    }
     default:
       break;
   }
@@ -498,11 +639,33 @@ gst_aasink_get_property (GObject * object, guint prop_id, GValue * value,
       break;
     }
     case PROP_FRAMES_DISPLAYED:{
+      GST_OBJECT_LOCK (aasink);
       g_value_set_int (value, aasink->frames_displayed);
+      GST_OBJECT_UNLOCK (aasink);
       break;
     }
     case PROP_FRAME_TIME:{
+      GST_OBJECT_LOCK (aasink);
       g_value_set_int (value, aasink->frame_time / 1000000);
+      GST_OBJECT_UNLOCK (aasink);
+      break;
+    }
+    case PROP_FRAMES_DROPPED:{
+      GST_OBJECT_LOCK (aasink);
+      g_value_set_uint64 (value, aasink->frames_dropped);
+      GST_OBJECT_UNLOCK (aasink);
+      break;
+    }
+    case PROP_STATS:{
+      GST_OBJECT_LOCK (aasink);
+      g_value_take_boxed (value, gst_aasink_get_stats (aasink));
+      GST_OBJECT_UNLOCK (aasink);
+      break;
+    }
+    case PROP_N_THREADS:{
+      GST_OBJECT_LOCK (aasink);
+      g_value_set_uint (value, aasink->n_threads);
+      GST_OBJECT_UNLOCK (aasink);
       break;
     }
     default:{
@@ -524,21 +687,76 @@ gst_aasink_open (GstAASink * aasink)
           ("error opening aalib context"));
       return FALSE;
     }
+    gst_aa_tables_attach (aasink->context);
     aa_autoinitkbd (aasink->context, 0);
     aa_resizehandler (aasink->context, (void *) aa_resize);
   }
+  if (!aasink->task_runner)
+    gst_aasink_update_task_runner (aasink);
+  if (!aasink->scaler)
+    aasink->scaler = gst_aa_scaler_new ();
   return TRUE;
 }
 
 static gboolean
 gst_aasink_close (GstAASink * aasink)
 {
+  gst_aa_tables_detach (aasink->context);
   aa_close (aasink->context);
   aasink->context = NULL;
 
+  if (aasink->task_runner) {
+    gst_aa_task_runner_free (aasink->task_runner);
+    aasink->task_runner = NULL;
+  }
+  if (aasink->scaler) {
+    gst_aa_scaler_free (aasink->scaler);
+    aasink->scaler = NULL;
+  }
+
   return TRUE;
 }
 
+static void
+gst_aasink_reset_stats (GstAASink * aasink)
+{
+  guint i;
+
+  GST_OBJECT_LOCK (aasink);
+  aasink->frames_displayed = 0;
+  aasink->frames_dropped = 0;
+  aasink->frame_time = 0;
+  aasink->late = FALSE;
+  aasink->qos_posted = 0;
+  for (i = 0; i < GST_AASINK_N_STAGES; i++)
+    gst_aa_stats_reset (&aasink->stats[i]);
+  gst_aa_stats_reset (&aasink->latency);
+  GST_OBJECT_UNLOCK (aasink);
+}
+
+/* GstBaseSink reports the buffers it drops for being late in QoS messages,
+ * pick the count up from there */
+static gboolean
+gst_aasink_post_message (GstElement * element, GstMessage * message)
+{
+  GstAASink *aasink = GST_AASINK (element);
+
+  if (GST_MESSAGE_TYPE (message) == GST_MESSAGE_QOS &&
+      GST_MESSAGE_SRC (message) == GST_OBJECT (element)) {
+    GstFormat format;
+    guint64 dropped;
+
+    gst_message_parse_qos_stats (message, &format, NULL, &dropped);
+    if (format == GST_FORMAT_BUFFERS && dropped != (guint64) - 1) {
+      GST_OBJECT_LOCK (aasink);
+      aasink->frames_dropped = MAX (aasink->frames_dropped, dropped);
+      GST_OBJECT_UNLOCK (aasink);
+    }
+  }
+
+  return GST_ELEMENT_CLASS (parent_class)->post_message (element, message);
+}
+
 static GstStateChangeReturn
 gst_aasink_change_state (GstElement * element, GstStateChange transition)
 {
@@ -551,6 +769,7 @@ gst_aasink_change_state (GstElement * element, GstStateChange transition)
     case GST_STATE_CHANGE_READY_TO_PAUSED:
       if (!gst_aasink_open (GST_AASINK (element)))
         goto open_failed;
+      gst_aasink_reset_stats (GST_AASINK (element));
       break;
     case GST_STATE_CHANGE_PAUSED_TO_PLAYING:
       break;
@@ -588,6 +807,11 @@ plugin_init (GstPlugin * plugin)
   
   if (!gst_element_register (plugin, "aatv", GST_RANK_NONE, GST_TYPE_AATV))
     return FALSE;
+
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+  if (!gst_tracer_register (plugin, "aatv", GST_TYPE_AA_TRACER))
+    return FALSE;
+#endif
   return TRUE;
 }
 
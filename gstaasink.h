@@ -27,6 +27,11 @@
 
 #include <aalib.h>
 
+#include "gstaascale.h"
+#include "gstaastats.h"
+#include "gstaatables.h"
+#include "gstaatask.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -46,6 +51,15 @@ extern "C" {
 typedef struct _GstAASink GstAASink;
 typedef struct _GstAASinkClass GstAASinkClass;
 
+/* timed steps of showing a frame, see the stats property */
+typedef enum {
+  GST_AASINK_STAGE_SCALE,
+  GST_AASINK_STAGE_MATCH,
+  GST_AASINK_STAGE_FLUSH,
+  GST_AASINK_STAGE_FRAME,
+  GST_AASINK_N_STAGES
+} GstAASinkStage;
+
 struct _GstAASink {
   GstVideoSink parent;
 
@@ -53,12 +67,24 @@ struct _GstAASink {
 
   gint frames_displayed;
   guint64 frame_time;
+  guint64 frames_dropped;
+  GstAAStats stats[GST_AASINK_N_STAGES];
+  /* buffer timestamp to flush done, in running time */
+  GstAAStats latency;
+  /* the last frame was slower than the frame rate, and when the last QoS
+   * message about that went out */
+  gboolean late;
+  GstClockTime qos_posted;
 
   aa_context *context;
   struct aa_hardware_params ascii_surf;
   struct aa_renderparams ascii_parms;
   aa_palette palette;
   gint aa_driver;
+
+  guint n_threads;
+  GstAATaskRunner *task_runner;
+  GstAAScaler *scaler;
 };
 
 struct _GstAASinkClass {
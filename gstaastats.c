@@ -0,0 +1,177 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* per-stage timing counters. Adding a sample is a handful of integer
+ * operations, the percentiles are only worked out when read. Samples fall
+ * into buckets an eighth of a power of two wide, so a percentile is exact
+ * to within 12.5%. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstaastats.h"
+
+/* samples the histogram holds before it is halved */
+#define GST_AA_STATS_WINDOW 1024
+
+#define GST_AA_STATS_SUB (1 << GST_AA_STATS_SUB_BITS)
+
+static guint
+gst_aa_stats_bucket (GstClockTime value)
+{
+  guint k;
+
+  if (value < GST_AA_STATS_SUB)
+    return value;
+
+  /* floor (log2 (value)), g_bit_storage () only takes a gulong */
+  if (value >> 32)
+    k = 32 + g_bit_storage ((gulong) (value >> 32)) - 1;
+  else
+    k = g_bit_storage ((gulong) value) - 1;
+  return (k - GST_AA_STATS_SUB_BITS + 1) * GST_AA_STATS_SUB +
+      ((value >> (k - GST_AA_STATS_SUB_BITS)) & (GST_AA_STATS_SUB - 1));
+}
+
+/* largest value that falls into bucket */
+static GstClockTime
+gst_aa_stats_bucket_max (guint bucket)
+{
+  guint e;
+
+  if (bucket < GST_AA_STATS_SUB)
+    return bucket;
+
+  e = bucket / GST_AA_STATS_SUB - 1;
+  return (((GstClockTime) GST_AA_STATS_SUB + bucket % GST_AA_STATS_SUB) << e)
+      + (((GstClockTime) 1 << e) - 1);
+}
+
+void
+gst_aa_stats_reset (GstAAStats * stats)
+{
+  memset (stats, 0, sizeof (GstAAStats));
+}
+
+void
+gst_aa_stats_add (GstAAStats * stats, GstClockTime elapsed)
+{
+  stats->last = elapsed;
+  stats->total += elapsed;
+  stats->count++;
+
+  if (stats->n_samples == GST_AA_STATS_WINDOW) {
+    guint i;
+
+    stats->n_samples = 0;
+    for (i = 0; i < GST_AA_STATS_N_BUCKETS; i++) {
+      stats->buckets[i] /= 2;
+      stats->n_samples += stats->buckets[i];
+    }
+  }
+
+  stats->buckets[gst_aa_stats_bucket (elapsed)]++;
+  stats->n_samples++;
+}
+
+GstClockTime
+gst_aa_stats_get_mean (const GstAAStats * stats)
+{
+  if (stats->count == 0)
+    return 0;
+
+  return stats->total / stats->count;
+}
+
+/* the smallest bucket bound that percent of the recent samples stay under */
+GstClockTime
+gst_aa_stats_get_percentile (const GstAAStats * stats, guint percent)
+{
+  guint64 rank, seen = 0;
+  guint i;
+
+  if (stats->n_samples == 0)
+    return 0;
+
+  rank = ((guint64) stats->n_samples * percent + 99) / 100;
+  for (i = 0; i < GST_AA_STATS_N_BUCKETS; i++) {
+    seen += stats->buckets[i];
+    if (seen >= rank && seen > 0)
+      return gst_aa_stats_bucket_max (i);
+  }
+
+  return gst_aa_stats_bucket_max (GST_AA_STATS_N_BUCKETS - 1);
+}
+
+/* sets name-last, name-mean and name-p99 on structure */
+void
+gst_aa_stats_set_fields (const GstAAStats * stats, GstStructure * structure,
+    const gchar * name)
+{
+  gchar *last = g_strconcat (name, "-last", NULL);
+  gchar *mean = g_strconcat (name, "-mean", NULL);
+  gchar *p99 = g_strconcat (name, "-p99", NULL);
+
+  gst_structure_set (structure,
+      last, G_TYPE_UINT64, stats->last,
+      mean, G_TYPE_UINT64, gst_aa_stats_get_mean (stats),
+      p99, G_TYPE_UINT64, gst_aa_stats_get_percentile (stats, 99), NULL);
+
+  g_free (last);
+  g_free (mean);
+  g_free (p99);
+}
+
+/* sets name-histogram-max and name-histogram-count on structure, the upper
+ * bound and the number of recent samples of every bucket that holds any */
+void
+gst_aa_stats_set_histogram (const GstAAStats * stats,
+    GstStructure * structure, const gchar * name)
+{
+  gchar *max = g_strconcat (name, "-histogram-max", NULL);
+  gchar *count = g_strconcat (name, "-histogram-count", NULL);
+  GValue maxes = G_VALUE_INIT;
+  GValue counts = G_VALUE_INIT;
+  GValue v = G_VALUE_INIT;
+  guint i;
+
+  g_value_init (&maxes, GST_TYPE_ARRAY);
+  g_value_init (&counts, GST_TYPE_ARRAY);
+
+  for (i = 0; i < GST_AA_STATS_N_BUCKETS; i++) {
+    if (stats->buckets[i] == 0)
+      continue;
+
+    g_value_init (&v, G_TYPE_UINT64);
+    g_value_set_uint64 (&v, gst_aa_stats_bucket_max (i));
+    gst_value_array_append_and_take_value (&maxes, &v);
+    g_value_init (&v, G_TYPE_UINT);
+    g_value_set_uint (&v, stats->buckets[i]);
+    gst_value_array_append_and_take_value (&counts, &v);
+  }
+
+  gst_structure_take_value (structure, max, &maxes);
+  gst_structure_take_value (structure, count, &counts);
+
+  g_free (max);
+  g_free (count);
+}
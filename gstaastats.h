@@ -0,0 +1,62 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_AA_STATS_H__
+#define __GST_AA_STATS_H__
+
+#include <gst/gst.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* each power of two is split into 1 << GST_AA_STATS_SUB_BITS buckets */
+#define GST_AA_STATS_SUB_BITS 3
+#define GST_AA_STATS_N_BUCKETS (64 << GST_AA_STATS_SUB_BITS)
+
+	typedef struct _GstAAStats GstAAStats;
+
+	/* timings of one processing stage, in nanoseconds */
+	struct _GstAAStats {
+		GstClockTime last;
+		GstClockTime total;
+		guint64 count;
+
+		/* log scaled histogram of the recent samples, halved whenever it
+		 * holds a full window so old samples fade out */
+		guint n_samples;
+		guint32 buckets[GST_AA_STATS_N_BUCKETS];
+	};
+
+	void gst_aa_stats_reset (GstAAStats * stats);
+	void gst_aa_stats_add (GstAAStats * stats, GstClockTime elapsed);
+	GstClockTime gst_aa_stats_get_mean (const GstAAStats * stats);
+	GstClockTime gst_aa_stats_get_percentile (const GstAAStats * stats,
+			guint percent);
+	void gst_aa_stats_set_fields (const GstAAStats * stats,
+			GstStructure * structure, const gchar * name);
+	void gst_aa_stats_set_histogram (const GstAAStats * stats,
+			GstStructure * structure, const gchar * name);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AA_STATS_H__ */
@@ -0,0 +1,346 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* aalib builds its character matching tables the first time a context
+ * renders, which takes a good fraction of a second on slow machines and is
+ * repeated for every new context. The tables only depend on the font, the
+ * supported attributes and the dim/bold multipliers, so they are built once
+ * per process and shared read-only by every context with the same setup.
+ *
+ * If GST_AA_TABLE_CACHE names a directory the tables are also written there
+ * and mapped back from the file by later processes.
+ *
+ * aalib frees the tables of a context in aa_close() and aa_setfont(), so
+ * shared tables have to be detached with gst_aa_tables_detach() before
+ * calling either of them.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "gstaatables.h"
+
+#ifndef AA_NATTRS
+#define AA_NATTRS 5
+#endif
+
+#ifndef AA_LIB_VERSIONCODE
+#define AA_LIB_VERSIONCODE 0
+#endif
+
+/* sizes of the arrays aa_mktable() allocates */
+#define GST_AA_TABLE_SIZE (65536 * sizeof (unsigned short))
+#define GST_AA_FILLTABLE_SIZE (256 * sizeof (unsigned short))
+#define GST_AA_PARAMETERS_SIZE (256 * AA_NATTRS * sizeof (struct parameters))
+
+#define GST_AA_TABLES_MAGIC "GSTAATB2"
+
+typedef struct
+{
+  gchar magic[8];
+  guint32 font_hash;
+  guint32 supported;
+  gdouble dimmul;
+  gdouble boldmul;
+  guint32 table_size;
+  guint32 filltable_size;
+  guint32 parameters_size;
+  /* the aalib the tables were built by, another build may lay them out
+   * differently even for the same font */
+  guint32 aalib_version;
+  guint32 nattrs;
+  guint32 parameter_size;
+} GstAATablesHeader;
+
+typedef struct
+{
+  const struct aa_font *font;
+  guint32 font_hash;
+  gint supported;
+  gdouble dimmul;
+  gdouble boldmul;
+
+  unsigned short *table;
+  unsigned short *filltable;
+  struct parameters *parameters;
+
+  /* set when the tables point into a cache file */
+  GMappedFile *file;
+} GstAATables;
+
+static GMutex tables_lock;
+static GSList *tables_cache;
+
+static guint32
+gst_aa_tables_hash_font (const struct aa_font *font)
+{
+  const guint8 *data = font->data;
+  guint32 hash = 5381;
+  gint i;
+
+  for (i = 0; i < 256 * font->height; i++)
+    hash = hash * 33 + data[i];
+
+  return hash;
+}
+
+static gboolean
+gst_aa_tables_match (GstAATables * tables, aa_context * context)
+{
+  return tables->font == context->params.font &&
+      tables->supported == context->params.supported &&
+      tables->dimmul == context->params.dimmul &&
+      tables->boldmul == context->params.boldmul;
+}
+
+static gboolean
+gst_aa_tables_is_shared (gconstpointer data)
+{
+  GSList *walk;
+
+  for (walk = tables_cache; walk; walk = walk->next) {
+    GstAATables *tables = walk->data;
+
+    if (data == tables->table || data == tables->filltable ||
+        data == tables->parameters)
+      return TRUE;
+  }
+  return FALSE;
+}
+
+static void
+gst_aa_tables_fill_header (GstAATables * tables, GstAATablesHeader * header)
+{
+  memset (header, 0, sizeof (GstAATablesHeader));
+  memcpy (header->magic, GST_AA_TABLES_MAGIC, sizeof (header->magic));
+  header->font_hash = tables->font_hash;
+  header->supported = tables->supported;
+  header->dimmul = tables->dimmul;
+  header->boldmul = tables->boldmul;
+  header->table_size = GST_AA_TABLE_SIZE;
+  header->filltable_size = GST_AA_FILLTABLE_SIZE;
+  header->parameters_size = GST_AA_PARAMETERS_SIZE;
+  header->aalib_version = AA_LIB_VERSIONCODE;
+  header->nattrs = AA_NATTRS;
+  header->parameter_size = sizeof (struct parameters);
+}
+
+static gchar *
+gst_aa_tables_get_filename (GstAATables * tables)
+{
+  const gchar *dir = g_getenv ("GST_AA_TABLE_CACHE");
+  gchar *name, *filename;
+
+  if (dir == NULL || *dir == '\0')
+    return NULL;
+
+  name = g_strdup_printf ("%s-%x-%08x-aa%d-%dx%u.tables",
+      tables->font->shortname, tables->supported, tables->font_hash,
+      AA_LIB_VERSIONCODE, AA_NATTRS, (guint) sizeof (struct parameters));
+  filename = g_build_filename (dir, name, NULL);
+  g_free (name);
+
+  return filename;
+}
+
+/* aalib stores the character in the low byte of every table entry and the
+ * attribute in the high byte and indexes its arrays with both without
+ * checking them */
+static gboolean
+gst_aa_tables_validate (const unsigned short *table, gint size)
+{
+  gint i;
+
+  for (i = 0; i < size; i++)
+    if ((table[i] >> 8) >= AA_NATTRS)
+      return FALSE;
+
+  return TRUE;
+}
+
+static gboolean
+gst_aa_tables_load (GstAATables * tables)
+{
+  GstAATablesHeader header;
+  GMappedFile *file;
+  gchar *filename;
+  gchar *data;
+
+  filename = gst_aa_tables_get_filename (tables);
+  if (filename == NULL)
+    return FALSE;
+
+  file = g_mapped_file_new (filename, FALSE, NULL);
+  g_free (filename);
+  if (file == NULL)
+    return FALSE;
+
+  gst_aa_tables_fill_header (tables, &header);
+  data = g_mapped_file_get_contents (file);
+
+  if (g_mapped_file_get_length (file) != sizeof (header) +
+      GST_AA_TABLE_SIZE + GST_AA_FILLTABLE_SIZE + GST_AA_PARAMETERS_SIZE ||
+      memcmp (data, &header, sizeof (header)) != 0) {
+    GST_WARNING ("ignoring stale aalib table cache");
+    g_mapped_file_unref (file);
+    return FALSE;
+  }
+
+  data += sizeof (header);
+  if (!gst_aa_tables_validate ((unsigned short *) data, 65536) ||
+      !gst_aa_tables_validate ((unsigned short *) (data + GST_AA_TABLE_SIZE),
+          256)) {
+    GST_WARNING ("ignoring corrupt aalib table cache");
+    g_mapped_file_unref (file);
+    return FALSE;
+  }
+
+  tables->table = (unsigned short *) data;
+  data += GST_AA_TABLE_SIZE;
+  tables->filltable = (unsigned short *) data;
+  data += GST_AA_FILLTABLE_SIZE;
+  tables->parameters = (struct parameters *) data;
+  tables->file = file;
+
+  return TRUE;
+}
+
+static void
+gst_aa_tables_save (GstAATables * tables)
+{
+  GstAATablesHeader header;
+  gchar *filename, *dir;
+  gchar *data, *dest;
+  gsize size;
+  GError *err = NULL;
+
+  filename = gst_aa_tables_get_filename (tables);
+  if (filename == NULL)
+    return;
+
+  gst_aa_tables_fill_header (tables, &header);
+  size = sizeof (header) + GST_AA_TABLE_SIZE + GST_AA_FILLTABLE_SIZE +
+      GST_AA_PARAMETERS_SIZE;
+  dest = data = g_malloc (size);
+  memcpy (dest, &header, sizeof (header));
+  dest += sizeof (header);
+  memcpy (dest, tables->table, GST_AA_TABLE_SIZE);
+  dest += GST_AA_TABLE_SIZE;
+  memcpy (dest, tables->filltable, GST_AA_FILLTABLE_SIZE);
+  dest += GST_AA_FILLTABLE_SIZE;
+  memcpy (dest, tables->parameters, GST_AA_PARAMETERS_SIZE);
+
+  dir = g_path_get_dirname (filename);
+  g_mkdir_with_parents (dir, 0755);
+  g_free (dir);
+
+  /* written to a temporary file and renamed, so readers never map a
+   * partial file */
+  if (!g_file_set_contents (filename, data, size, &err)) {
+    GST_WARNING ("could not write aalib table cache: %s", err->message);
+    g_error_free (err);
+  }
+
+  g_free (data);
+  g_free (filename);
+}
+
+/* lets aalib build the tables for the setup of context and takes them over,
+ * aa_render() does that when the context has no tables yet */
+static void
+gst_aa_tables_build (GstAATables * tables, aa_context * context)
+{
+  if (context->table == NULL)
+    aa_render (context, &aa_defrenderparams, 0, 0, 1, 1);
+
+  tables->table = context->table;
+  tables->filltable = context->filltable;
+  tables->parameters = context->parameters;
+
+  context->table = NULL;
+  context->filltable = NULL;
+  context->parameters = NULL;
+}
+
+/* points the tables of context at the shared ones for its font and
+ * attributes, building or loading them first if needed */
+void
+gst_aa_tables_attach (aa_context * context)
+{
+  GstAATables *tables = NULL;
+  GSList *walk;
+
+  g_mutex_lock (&tables_lock);
+
+  for (walk = tables_cache; walk; walk = walk->next) {
+    if (gst_aa_tables_match (walk->data, context)) {
+      tables = walk->data;
+      break;
+    }
+  }
+
+  if (tables == NULL) {
+    tables = g_new0 (GstAATables, 1);
+    tables->font = context->params.font;
+    tables->font_hash = gst_aa_tables_hash_font (tables->font);
+    tables->supported = context->params.supported;
+    tables->dimmul = context->params.dimmul;
+    tables->boldmul = context->params.boldmul;
+
+    if (!gst_aa_tables_load (tables)) {
+      gst_aa_tables_build (tables, context);
+      gst_aa_tables_save (tables);
+    }
+    tables_cache = g_slist_prepend (tables_cache, tables);
+  }
+
+  /* drop any tables aalib built for this context on its own */
+  if (context->table && !gst_aa_tables_is_shared (context->table))
+    free (context->table);
+  if (context->filltable && !gst_aa_tables_is_shared (context->filltable))
+    free (context->filltable);
+  if (context->parameters && !gst_aa_tables_is_shared (context->parameters))
+    free (context->parameters);
+
+  context->table = tables->table;
+  context->filltable = tables->filltable;
+  context->parameters = tables->parameters;
+
+  g_mutex_unlock (&tables_lock);
+}
+
+/* forgets the shared tables of context so aalib doesn't free them */
+void
+gst_aa_tables_detach (aa_context * context)
+{
+  g_mutex_lock (&tables_lock);
+
+  if (gst_aa_tables_is_shared (context->table))
+    context->table = NULL;
+  if (gst_aa_tables_is_shared (context->filltable))
+    context->filltable = NULL;
+  if (gst_aa_tables_is_shared (context->parameters))
+    context->parameters = NULL;
+
+  g_mutex_unlock (&tables_lock);
+}
@@ -0,0 +1,245 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* A small pool of worker threads that runs one batch of tasks at a time.
+ * The calling thread always runs the first task itself and then waits for
+ * the workers to finish the rest, so a runner with one thread has no
+ * workers and no locking at all.
+ *
+ * gst_aa_render_bands() uses it to let aalib convert horizontal bands of
+ * the canvas to characters at the same time.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstaatask.h"
+
+struct _GstAATaskRunner
+{
+  guint n_threads;
+  GThread **threads;
+
+  GMutex lock;
+  GCond cond_todo;
+  GCond cond_done;
+
+  GstAATaskFunc func;
+  gpointer *task_data;
+  /* index of the next task to hand out, counts down to 0 */
+  guint n_todo;
+  /* tasks handed out to workers that have not finished yet */
+  guint n_pending;
+  gboolean quit;
+};
+
+static gpointer
+gst_aa_task_runner_thread (gpointer data)
+{
+  GstAATaskRunner *runner = data;
+  guint idx;
+
+  g_mutex_lock (&runner->lock);
+  for (;;) {
+    while (!runner->quit && runner->n_todo == 0)
+      g_cond_wait (&runner->cond_todo, &runner->lock);
+    if (runner->quit)
+      break;
+
+    idx = runner->n_todo--;
+    g_mutex_unlock (&runner->lock);
+
+    runner->func (runner->task_data[idx]);
+
+    g_mutex_lock (&runner->lock);
+    if (--runner->n_pending == 0)
+      g_cond_signal (&runner->cond_done);
+  }
+  g_mutex_unlock (&runner->lock);
+
+  return NULL;
+}
+
+/* the number of threads a runner for n_threads gets, 0 means one per core */
+guint
+gst_aa_task_runner_resolve_n_threads (guint n_threads)
+{
+  if (n_threads == 0)
+    n_threads = g_get_num_processors ();
+
+  return MIN (n_threads, GST_AA_TASK_RUNNER_MAX_THREADS);
+}
+
+GstAATaskRunner *
+gst_aa_task_runner_new (guint n_threads)
+{
+  GstAATaskRunner *runner;
+  guint i;
+
+  n_threads = gst_aa_task_runner_resolve_n_threads (n_threads);
+
+  runner = g_new0 (GstAATaskRunner, 1);
+  runner->n_threads = n_threads;
+
+  g_mutex_init (&runner->lock);
+  g_cond_init (&runner->cond_todo);
+  g_cond_init (&runner->cond_done);
+
+  runner->threads = g_new0 (GThread *, n_threads);
+  for (i = 1; i < n_threads; i++)
+    runner->threads[i] =
+        g_thread_new ("aa-worker", gst_aa_task_runner_thread, runner);
+
+  return runner;
+}
+
+void
+gst_aa_task_runner_free (GstAATaskRunner * runner)
+{
+  guint i;
+
+  g_mutex_lock (&runner->lock);
+  runner->quit = TRUE;
+  g_cond_broadcast (&runner->cond_todo);
+  g_mutex_unlock (&runner->lock);
+
+  for (i = 1; i < runner->n_threads; i++)
+    g_thread_join (runner->threads[i]);
+
+  g_free (runner->threads);
+  g_mutex_clear (&runner->lock);
+  g_cond_clear (&runner->cond_todo);
+  g_cond_clear (&runner->cond_done);
+  g_free (runner);
+}
+
+guint
+gst_aa_task_runner_get_n_threads (GstAATaskRunner * runner)
+{
+  return runner->n_threads;
+}
+
+/* runs func once for each of the first n_tasks entries of task_data and
+ * returns when all of them are done, n_tasks must not exceed n_threads */
+void
+gst_aa_task_runner_run (GstAATaskRunner * runner, GstAATaskFunc func,
+    gpointer * task_data, guint n_tasks)
+{
+  g_return_if_fail (n_tasks <= runner->n_threads);
+
+  if (n_tasks == 0)
+    return;
+
+  if (n_tasks > 1) {
+    g_mutex_lock (&runner->lock);
+    runner->func = func;
+    runner->task_data = task_data;
+    runner->n_todo = n_tasks - 1;
+    runner->n_pending = n_tasks - 1;
+    g_cond_broadcast (&runner->cond_todo);
+    g_mutex_unlock (&runner->lock);
+  }
+
+  func (task_data[0]);
+
+  if (n_tasks > 1) {
+    g_mutex_lock (&runner->lock);
+    while (runner->n_pending > 0)
+      g_cond_wait (&runner->cond_done, &runner->lock);
+    g_mutex_unlock (&runner->lock);
+  }
+}
+
+typedef struct
+{
+  aa_context *context;
+  const int *palette;
+  const struct aa_renderparams *params;
+  gint row_start;
+  gint row_end;
+} GstAARenderBand;
+
+static void
+gst_aa_render_band (GstAARenderBand * band)
+{
+  aa_renderpalette (band->context, band->palette, band->params, 0,
+      band->row_start, aa_scrwidth (band->context), band->row_end);
+}
+
+/* aa_renderpalette() works on character rows, every band only reads its own
+ * 2x2 image blocks and writes its own cells. That doesn't hold for the error
+ * diffusion ditherers, which push error into the next row (and across band
+ * edges), nor for randomval which steps a PRNG shared by the whole call, so
+ * those always render as a single band. The character table is built lazily
+ * by the first render call, which must not race either. */
+static gboolean
+gst_aa_render_can_split (aa_context * context,
+    const struct aa_renderparams *params)
+{
+  if (params->dither == AA_ERRORDISTRIB || params->dither == AA_FLOYD_S)
+    return FALSE;
+  if (params->randomval != 0)
+    return FALSE;
+  if (context->table == NULL)
+    return FALSE;
+  return TRUE;
+}
+
+void
+gst_aa_render_bands (GstAATaskRunner * runner, aa_context * context,
+    const struct aa_renderparams *params)
+{
+  GstAARenderBand *bands;
+  gpointer *task_data;
+  aa_palette palette;
+  guint height = aa_scrheight (context);
+  guint n_bands, i;
+
+  /* the identity palette aa_render() would pass, it keeps that in a static
+   * table it fills on first use, which every band would write at once */
+  for (i = 0; i < 256; i++)
+    palette[i] = i;
+
+  if (runner == NULL || !gst_aa_render_can_split (context, params))
+    n_bands = 1;
+  else
+    n_bands = MIN (gst_aa_task_runner_get_n_threads (runner), MAX (height, 1));
+
+  if (n_bands == 1) {
+    aa_renderpalette (context, palette, params, 0, 0, aa_scrwidth (context),
+        height);
+    return;
+  }
+
+  bands = g_newa (GstAARenderBand, n_bands);
+  task_data = g_newa (gpointer, n_bands);
+
+  for (i = 0; i < n_bands; i++) {
+    bands[i].context = context;
+    bands[i].palette = palette;
+    bands[i].params = params;
+    bands[i].row_start = height * i / n_bands;
+    bands[i].row_end = height * (i + 1) / n_bands;
+    task_data[i] = &bands[i];
+  }
+
+  gst_aa_task_runner_run (runner, (GstAATaskFunc) gst_aa_render_band,
+      task_data, n_bands);
+}
@@ -0,0 +1,53 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __GST_AA_TASK_H__
+#define __GST_AA_TASK_H__
+
+#include <gst/gst.h>
+#include <aalib.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* upper bound of the n-threads properties */
+#define GST_AA_TASK_RUNNER_MAX_THREADS 64
+
+typedef struct _GstAATaskRunner GstAATaskRunner;
+
+typedef void (*GstAATaskFunc) (gpointer task_data);
+
+guint gst_aa_task_runner_resolve_n_threads (guint n_threads);
+GstAATaskRunner *gst_aa_task_runner_new (guint n_threads);
+void gst_aa_task_runner_free (GstAATaskRunner * runner);
+guint gst_aa_task_runner_get_n_threads (GstAATaskRunner * runner);
+void gst_aa_task_runner_run (GstAATaskRunner * runner, GstAATaskFunc func,
+    gpointer * task_data, guint n_tasks);
+
+void gst_aa_render_bands (GstAATaskRunner * runner, aa_context * context,
+    const struct aa_renderparams * params);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AA_TASK_H__ */
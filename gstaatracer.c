@@ -0,0 +1,105 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+/**
+ * SECTION:tracer-aatv
+ *
+ * Logs the time every processing stage of aatv and aasink takes, one
+ * aatv-stage record per stage and frame:
+ * |[
+ * GST_TRACERS=aatv GST_DEBUG=GST_TRACER:7 gst-launch-1.0 ... ! aatv ! ...
+ * ]|
+ * The stages are rain, scale, match and render for aatv and scale, match
+ * and flush for aasink. The elements only check an integer per stage while
+ * the tracer isn't loaded.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstaatracer.h"
+
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+
+gint _gst_aa_tracer_active = 0;
+
+static GstTracerRecord *tr_stage;
+/* the records' ts is relative to the first tracer */
+static GstClockTime start_time;
+
+#define gst_aa_tracer_parent_class parent_class
+G_DEFINE_TYPE (GstAATracer, gst_aa_tracer, GST_TYPE_TRACER);
+
+void
+gst_aa_tracer_log_stage (GstElement * element, const gchar * stage,
+    GstClockTime start, GstClockTime end)
+{
+  gst_tracer_record_log (tr_stage, (guint64) (guintptr) g_thread_self (),
+      (guint64) GST_CLOCK_DIFF (start_time, end), GST_OBJECT_NAME (element),
+      stage, (guint64) GST_CLOCK_DIFF (start, end));
+}
+
+static void
+gst_aa_tracer_finalize (GObject * object)
+{
+  g_atomic_int_add (&_gst_aa_tracer_active, -1);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
+}
+
+static void
+gst_aa_tracer_class_init (GstAATracerClass * klass)
+{
+  GObjectClass *gobject_class = G_OBJECT_CLASS (klass);
+
+  gobject_class->finalize = gst_aa_tracer_finalize;
+
+  tr_stage = gst_tracer_record_new ("aatv-stage.class",
+      "thread-id", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_THREAD, NULL),
+      "ts", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "time the stage ended",
+          "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+          "max", G_TYPE_UINT64, G_MAXUINT64, NULL),
+      "element", GST_TYPE_STRUCTURE, gst_structure_new ("scope",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "related-to", GST_TYPE_TRACER_VALUE_SCOPE,
+          GST_TRACER_VALUE_SCOPE_ELEMENT, NULL),
+      "stage", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_STRING,
+          "description", G_TYPE_STRING, "name of the processing stage", NULL),
+      "time", GST_TYPE_STRUCTURE, gst_structure_new ("value",
+          "type", G_TYPE_GTYPE, G_TYPE_UINT64,
+          "description", G_TYPE_STRING, "time the stage took in ns",
+          "min", G_TYPE_UINT64, G_GUINT64_CONSTANT (0),
+          "max", G_TYPE_UINT64, G_MAXUINT64, NULL), NULL);
+  GST_OBJECT_FLAG_SET (tr_stage, GST_OBJECT_FLAG_MAY_BE_LEAKED);
+}
+
+static void
+gst_aa_tracer_init (GstAATracer * self)
+{
+  if (g_atomic_int_add (&_gst_aa_tracer_active, 1) == 0)
+    start_time = gst_util_get_timestamp ();
+}
+
+#endif /* GST_DISABLE_GST_TRACER_HOOKS */
@@ -0,0 +1,75 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __GST_AA_TRACER_H__
+#define __GST_AA_TRACER_H__
+
+#include <gst/gst.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+#ifndef GST_DISABLE_GST_TRACER_HOOKS
+
+#include <gst/gsttracer.h>
+
+#define GST_TYPE_AA_TRACER \
+  (gst_aa_tracer_get_type())
+#define GST_AA_TRACER(obj) \
+  (G_TYPE_CHECK_INSTANCE_CAST((obj),GST_TYPE_AA_TRACER,GstAATracer))
+
+typedef struct _GstAATracer GstAATracer;
+typedef struct _GstAATracerClass GstAATracerClass;
+
+struct _GstAATracer {
+  GstTracer parent;
+};
+
+struct _GstAATracerClass {
+  GstTracerClass parent_class;
+};
+
+GType gst_aa_tracer_get_type (void);
+
+/* number of live aatv tracers, stages are only logged while it's non 0 */
+G_GNUC_INTERNAL extern gint _gst_aa_tracer_active;
+
+void gst_aa_tracer_log_stage (GstElement * element, const gchar * stage,
+    GstClockTime start, GstClockTime end);
+
+/* logs one stage of element that ran from start to end, as taken with
+ * gst_util_get_timestamp () */
+#define gst_aa_trace_stage(element,stage,start,end) G_STMT_START {	\
+  if (G_UNLIKELY (g_atomic_int_get (&_gst_aa_tracer_active)))		\
+    gst_aa_tracer_log_stage ((element), (stage), (start), (end));	\
+} G_STMT_END
+
+#else /* GST_DISABLE_GST_TRACER_HOOKS */
+
+#define gst_aa_trace_stage(element,stage,start,end) G_STMT_START { } G_STMT_END
+
+#endif /* GST_DISABLE_GST_TRACER_HOOKS */
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AA_TRACER_H__ */
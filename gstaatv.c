@@ -35,6 +35,7 @@
 #endif
 
 #include "gstaatv.h"
+#include "gstaatracer.h"
 #include <string.h>
 #include <stdlib.h>
 
@@ -49,6 +50,14 @@
 #define PROP_RAIN_DELAY_MAX_DEFAULT			2
 #define PROP_RAIN_LENGTH_MIN_DEFAULT 		4
 #define PROP_RAIN_LENGTH_MAX_DEFAULT 		30
+#define PROP_N_THREADS_DEFAULT				0
+#define PROP_INCREMENTAL_DEFAULT			FALSE
+#define PROP_FRAME_BUDGET_DEFAULT			0
+#define PROP_MIN_WIDTH_DEFAULT				20
+#define PROP_MIN_HEIGHT_DEFAULT				6
+#define PROP_STATS_INTERVAL_DEFAULT			0
+#define PROP_SEED_DEFAULT				0
+#define PROP_BRIGHTNESS_AUTO_MODE_DEFAULT	GST_AATV_BRIGHTNESS_STEP
 
 /* aatv signals and args */
 enum
@@ -56,7 +65,21 @@ enum
   LAST_SIGNAL
 };
 
-#define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
+/* output frames at least this large are written with non-temporal stores so
+ * they don't evict the font and palette from the cache */
+#define GST_AATV_STREAM_THRESHOLD	(4 * 1024 * 1024)
+
+/* glyph bytes are gathered in chunks of this many cells per kernel call */
+#define GST_AATV_RENDER_CHUNK		256
+
+/* frames to wait after the frame budget resized the canvas */
+#define GST_AATV_BUDGET_SETTLE		15
+
+/* histogram auto-brightness: frames darker than this say little about the
+ * gain, which is kept within sane bounds */
+#define GST_AATV_EXPOSURE_MIN_LEVEL	0.02
+#define GST_AATV_EXPOSURE_MIN_GAIN	0.05
+#define GST_AATV_EXPOSURE_MAX_GAIN	4.0
 
 enum
 {
@@ -87,24 +110,42 @@ enum
   PROP_RAIN_DELAY_MIN,
   PROP_RAIN_DELAY_MAX,
   PROP_RAIN_LENGTH_MIN,
-  PROP_RAIN_LENGTH_MAX
+  PROP_RAIN_LENGTH_MAX,
+  PROP_N_THREADS,
+  PROP_INCREMENTAL,
+  PROP_FRAMES_DROPPED,
+  PROP_FRAME_BUDGET,
+  PROP_MIN_WIDTH,
+  PROP_MIN_HEIGHT,
+  PROP_STATS,
+  PROP_STATS_INTERVAL,
+  PROP_SEED,
+  PROP_BRIGHTNESS_AUTO_MODE
 };
 
 static GstStaticPadTemplate sink_template_tv = GST_STATIC_PAD_TEMPLATE ("sink",
     GST_PAD_SINK,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ I420}"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_AA_SCALE_FORMATS))
     );
 static GstStaticPadTemplate src_template_tv = GST_STATIC_PAD_TEMPLATE ("src",
     GST_PAD_SRC,
     GST_PAD_ALWAYS,
-    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE ("{ RGBA }"))
+    GST_STATIC_CAPS (GST_VIDEO_CAPS_MAKE (GST_AATV_RENDER_FORMATS) "; "
+        GST_AATV_CELLS_CAPS)
     );
 
 static void gst_aatv_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec);
 static void gst_aatv_get_property (GObject * object, guint prop_id,
     GValue * value, GParamSpec * pspec);
+static void gst_aatv_finalize (GObject * object);
+static void gst_aatv_rain_reset (GstAATv * aatv);
+static GstAATvCanvas *gst_aatv_request_canvas (GstAATv * aatv, gint width,
+    gint height);
+static void gst_aatv_submit_canvas (GstAATv * aatv, GstAATvCanvas * canvas,
+    gboolean sync);
+static void gst_aatv_update_canvas (GstAATv * aatv);
 
 #define GST_TYPE_AATV_RAIN_MODE (gst_aatv_rain_mode_get_type())
 
@@ -128,236 +169,1329 @@ gst_aatv_rain_mode_get_type (void)
   return rain_mode;
 }
 
+#define GST_TYPE_AATV_BRIGHTNESS_MODE (gst_aatv_brightness_mode_get_type())
+
+static GType
+gst_aatv_brightness_mode_get_type (void)
+{
+  static GType brightness_mode = 0;
+
+  static const GEnumValue brightness_modes[] = {
+    {GST_AATV_BRIGHTNESS_STEP, "One step per frame", "step"},
+    {GST_AATV_BRIGHTNESS_HISTOGRAM, "Picked from the frame's histogram",
+        "histogram"},
+    {0, NULL, NULL},
+  };
+
+  if (!brightness_mode) {
+    brightness_mode =
+        g_enum_register_static ("GstAATvBrightnessModes", brightness_modes);
+  }
+  return brightness_mode;
+}
+
 #define gst_aatv_parent_class parent_class
 G_DEFINE_TYPE (GstAATv, gst_aatv, GST_TYPE_VIDEO_FILTER);
 
+/* seeds the per instance generator, 0 picks a random seed */
+static void
+gst_aatv_seed (GstAATv * aatv, guint seed)
+{
+  guint64 z;
+
+  if (seed == 0)
+    seed = g_random_int ();
+
+  /* splitmix64, spreads the seed over the whole state */
+  z = seed + G_GUINT64_CONSTANT (0x9e3779b97f4a7c15);
+  z = (z ^ (z >> 30)) * G_GUINT64_CONSTANT (0xbf58476d1ce4e5b9);
+  z = (z ^ (z >> 27)) * G_GUINT64_CONSTANT (0x94d049bb133111eb);
+  z ^= z >> 31;
+
+  /* xorshift never leaves an all zero state */
+  aatv->random_state = z != 0 ? z : 1;
+}
+
+/* xorshift64*, the high bits are the good ones */
+static inline guint64
+gst_aatv_random (GstAATv * aatv)
+{
+  guint64 x = aatv->random_state;
+
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  aatv->random_state = x;
+
+  return x * G_GUINT64_CONSTANT (0x2545f4914f6cdd1d);
+}
+
+/* n uniform 32 bit values, the two halves of each step of the generator.
+ * Only the lowest few bits of the low half are weak, the comparisons the
+ * values go into are decided by their top bits. */
 static void
-gst_aatv_scale (GstAATv * aatv, guchar * src, guchar * dest,
-    gint sw, gint sh, gint ss, gint dw, gint dh)
+gst_aatv_random_fill (GstAATv * aatv, guint32 * dest, guint n)
 {
-  gint ypos, yinc, y;
-  gint xpos, xinc, x;
+  guint i;
 
-  g_return_if_fail ((dw != 0) && (dh != 0));
+  for (i = 0; i + 1 < n; i += 2) {
+    guint64 r = gst_aatv_random (aatv);
 
-  ypos = 0x10000;
-  yinc = (sh << 16) / dh;
-  xinc = (sw << 16) / dw;
+    dest[i] = r >> 32;
+    dest[i + 1] = (guint32) r;
+  }
+  if (i < n)
+    dest[i] = gst_aatv_random (aatv) >> 32;
+}
 
-  for (y = dh; y; y--) {
-    while (ypos > 0x10000) {
-      ypos -= 0x10000;
-      src += ss;
+static guint
+gst_aatv_rand_range (GstAATv * aatv, guint lower, guint upper)
+{
+  return ((gst_aatv_random (aatv) >> 32) % (upper - lower + 1)) + lower;
+}
+
+/* marks the cells of every droplet in rain_mask, count cells from start on
+ * along the droplet's axis clipped to extent */
+static inline void
+gst_aatv_rain_span (guint8 * mask, gint start, gint count, gint extent,
+    guint step)
+{
+  gint end = MIN (start + count, extent);
+
+  for (start = MAX (start, 0); start < end; start++)
+    mask[start * step] = GST_AATV_CLASS_RAIN_NORMAL;
+}
+
+static void
+gst_aatv_rain_mask (GstAATv * aatv)
+{
+  gint width = aa_scrwidth (aatv->context);
+  gint height = aa_scrheight (aatv->context);
+  guint i;
+
+  memset (aatv->rain_mask, 0, width * height);
+
+  for (i = 0; i < aatv->rain_n_active; i++) {
+    gint index = aatv->rain_active[i];
+    GstAATvDroplet *drop = &aatv->raindrops[index];
+    /* a droplet covers location - length up to location */
+    gint first = drop->location - drop->length;
+    gint count = drop->length + 1;
+
+    switch (aatv->params.rain_mode) {
+      case GST_RAIN_DOWN:
+        if (index < width)
+          gst_aatv_rain_span (aatv->rain_mask + index, first, count, height,
+              width);
+        break;
+      case GST_RAIN_UP:
+        if (index < width)
+          gst_aatv_rain_span (aatv->rain_mask + index,
+              aatv->rain_height - drop->location, count, height, width);
+        break;
+      case GST_RAIN_LEFT:
+        if (index < height)
+          gst_aatv_rain_span (aatv->rain_mask + index * width, first, count,
+              width, 1);
+        break;
+      case GST_RAIN_RIGHT:
+        if (index < height)
+          gst_aatv_rain_span (aatv->rain_mask + index * width,
+              aatv->rain_height - drop->location, count, width, 1);
+        break;
+      default:
+        break;
     }
-    xpos = 0x10000;
-    {
-      guchar *destp = dest;
-      guchar *srcp = src;
+  }
+}
 
-      for (x = dw; x; x--) {
-        while (xpos >= 0x10000L) {
-          srcp++;
-          xpos -= 0x10000L;
-        }
-        *destp++ = *srcp;
-        xpos += xinc;
+static void
+gst_aatv_rain (GstAATv * aatv)
+{
+  GstAATvDroplet *raindrops = aatv->raindrops;
+  guint32 spawn_threshold;
+  guint i, n_falling, n_active;
+  gboolean obstructed;
+  gint column;
+
+  /* one draw per column, compared against the spawn rate in fixed point */
+  gst_aatv_random_fill (aatv, aatv->rain_random, aatv->rain_width);
+  spawn_threshold = aatv->params.rain_spawn_rate >= 1.0 ? G_MAXUINT32 :
+      (guint32) (aatv->params.rain_spawn_rate * 4294967296.0);
+
+  /* new droplets go to the end of the active list and start moving in the
+   * next frame */
+  n_falling = n_active = aatv->rain_n_active;
+  for (column = 0; column < aatv->rain_width; column++) {
+    if (raindrops[column].enabled ||
+        aatv->rain_random[column] >= spawn_threshold)
+      continue;
+
+    obstructed = FALSE;
+
+    /* Don't let adjacent lines be enabled at the same time. */
+    if (column > 0)
+      if (raindrops[column - 1].enabled == TRUE)
+        if (raindrops[column - 1].location - raindrops[column - 1].length <
+            aatv->rain_height / 4)
+          obstructed = TRUE;
+
+    if (column + 1 < aatv->rain_width)
+      if (raindrops[column + 1].enabled == TRUE)
+        if (raindrops[column + 1].location - raindrops[column + 1].length <
+            aatv->rain_height / 4)
+          obstructed = TRUE;
+
+    if (obstructed == FALSE) {
+      raindrops[column].location = 0;
+      raindrops[column].length =
+          gst_aatv_rand_range (aatv, aatv->params.rain_length_min,
+          aatv->params.rain_length_max);
+      raindrops[column].delay =
+          gst_aatv_rand_range (aatv, aatv->params.rain_delay_min,
+          aatv->params.rain_delay_max);
+      raindrops[column].delay_counter = 0;
+      raindrops[column].enabled = TRUE;
+      aatv->rain_active[n_active++] = column;
+    }
+  }
+
+  /* move the falling ones, dropping those that left the canvas */
+  aatv->rain_n_active = 0;
+  for (i = 0; i < n_active; i++) {
+    GstAATvDroplet *drop = &raindrops[aatv->rain_active[i]];
+
+    if (i < n_falling) {
+      drop->delay_counter++;
+      if (drop->delay_counter > drop->delay) {
+        drop->delay_counter = 0;
+        drop->location++;
+      }
+      if (drop->location - drop->length > aatv->rain_height) {
+        drop->enabled = FALSE;
+        continue;
       }
     }
-    dest += dw;
-    ypos += yinc;
+    aatv->rain_active[aatv->rain_n_active++] = aatv->rain_active[i];
   }
+
+  gst_aatv_rain_mask (aatv);
 }
 
-static guint
-gst_aatv_rand_range (guint lower, guint upper)
+/* rebuild the palette after a color change, every possible glyph row
+ * byte is expanded once per color class so rendering becomes a copy */
+static void
+gst_aatv_update_palette (GstAATv * aatv)
 {
-  return (rand () % (upper - lower + 1)) + lower;
+  GstAATvPalette *palette = &aatv->palette;
+  const GstAATvParams *params = &aatv->params;
+
+  palette->colors[GST_AATV_CLASS_TEXT_NORMAL] = params->color_text_normal;
+  palette->colors[GST_AATV_CLASS_TEXT_DIM] = params->color_text_dim;
+  palette->colors[GST_AATV_CLASS_TEXT_BOLD] = params->color_text_bold;
+  palette->colors[GST_AATV_CLASS_RAIN_NORMAL] = params->color_rain_normal;
+  palette->colors[GST_AATV_CLASS_RAIN_DIM] = params->color_rain_dim;
+  palette->colors[GST_AATV_CLASS_RAIN_BOLD] = params->color_rain_bold;
+  palette->background = params->color_background;
+
+  gst_aatv_palette_update (palette);
 }
 
+/* What a piece of output memory currently shows. Pool memory comes back to
+ * us with the pixels of an older frame still in it, so only cells whose
+ * character or color class differ from that frame need to be drawn again.
+ * It lives as qdata on the memory and goes away together with it. */
+typedef struct
+{
+  gint epoch;
+  guint width;
+  guint height;
+  guint8 *text;
+  guint8 *classes;
+} GstAATvCells;
+
+static GQuark gst_aatv_cells_quark;
+
 static void
-gst_aatv_rain (GstAATv * aatv)
+gst_aatv_cells_free (GstAATvCells * cells)
 {
+  g_free (cells->text);
+  g_free (cells->classes);
+  g_slice_free (GstAATvCells, cells);
+}
 
-  gint i;
-  gboolean obstructed;
+/* returns the cells shown by the single memory of buffer, creating them when
+ * the memory is new, or NULL when the buffer can't be tracked */
+static GstAATvCells *
+gst_aatv_get_cells (GstAATv * aatv, GstBuffer * buffer)
+{
+  GstMiniObject *mem;
+  GstAATvCells *cells;
+  guint width = aa_scrwidth (aatv->context);
+  guint height = aa_scrheight (aatv->context);
+
+  if (!aatv->params.incremental || gst_buffer_n_memory (buffer) != 1)
+    return NULL;
+
+  mem = GST_MINI_OBJECT_CAST (gst_buffer_peek_memory (buffer, 0));
+  cells = gst_mini_object_get_qdata (mem, gst_aatv_cells_quark);
+  if (cells == NULL) {
+    cells = g_slice_new0 (GstAATvCells);
+    /* never matches, so the first frame is drawn completely */
+    cells->epoch = aatv->epoch - 1;
+    gst_mini_object_set_qdata (mem, gst_aatv_cells_quark, cells,
+        (GDestroyNotify) gst_aatv_cells_free);
+  }
 
-  GstAATvDroplet *raindrops = aatv->raindrops;
+  if (cells->width != width || cells->height != height) {
+    cells->width = width;
+    cells->height = height;
+    cells->text = g_renew (guint8, cells->text, width * height);
+    cells->classes = g_renew (guint8, cells->classes, width * height);
+    cells->epoch = aatv->epoch - 1;
+  }
+
+  return cells;
+}
+
+/* everything drawn so far is stale, e.g. after caps, flushes or properties
+ * changed */
+static void
+gst_aatv_invalidate (GstAATv * aatv)
+{
+  g_atomic_int_inc (&aatv->epoch);
+}
+
+/* hands a copy of the settings to the streaming thread, replacing one it
+ * didn't pick up yet. Called with the object lock held, so there is only
+ * ever one setter swapping. */
+static void
+gst_aatv_publish_params (GstAATv * aatv)
+{
+  GstAATvParams *params = g_slice_dup (GstAATvParams, &aatv->settings);
+  GstAATvParams *old;
+
+  do {
+    old = g_atomic_pointer_get (&aatv->pending_params);
+  } while (!g_atomic_pointer_compare_and_exchange (&aatv->pending_params, old,
+          params));
+
+  if (old != NULL)
+    g_slice_free (GstAATvParams, old);
+}
 
-  for (i = 0; i < aatv->rain_width; i++) {
-    if (raindrops[i].enabled == FALSE) {
-      if ((((float) rand ()) / (float) RAND_MAX) < aatv->rain_spawn_rate) {
-
-        obstructed = FALSE;
-
-/* Don't let adjacent lines be enabled at the same time. */
-        if (i > 0)
-          if (raindrops[i - 1].enabled == TRUE)
-            if (raindrops[i - 1].location - raindrops[i - 1].length <
-                aatv->rain_height / 4)
-              obstructed = TRUE;
-
-        if (i < aatv->rain_width)
-          if (raindrops[i + 1].enabled == TRUE)
-            if (raindrops[i + 1].location - raindrops[i + 1].length <
-                aatv->rain_height / 4)
-              obstructed = TRUE;
-
-        if (obstructed == FALSE) {
-          raindrops[i].location = 0;
-          raindrops[i].length =
-              gst_aatv_rand_range (aatv->rain_length_min,
-              aatv->rain_length_max);
-          raindrops[i].delay =
-              gst_aatv_rand_range (aatv->rain_delay_min, aatv->rain_delay_max);
-          raindrops[i].delay_counter = 0;
-          raindrops[i].enabled = TRUE;
+/* takes the settings published since the last frame, if any, and applies
+ * what they change. Called by the streaming thread at the start of a frame,
+ * this never waits for a setter. */
+static void
+gst_aatv_update_params (GstAATv * aatv)
+{
+  GstAATvParams *params;
+  GstAATvParams *current = &aatv->params;
+  gboolean colors_changed, budget_changed, rain_changed;
+
+  do {
+    params = g_atomic_pointer_get (&aatv->pending_params);
+  } while (params != NULL &&
+      !g_atomic_pointer_compare_and_exchange (&aatv->pending_params, params,
+          NULL));
+
+  if (params == NULL)
+    return;
+
+  if (params->bright_serial != current->bright_serial)
+    g_atomic_int_set (&aatv->bright, params->ascii_parms.bright);
+  if (params->seed_serial != current->seed_serial)
+    gst_aatv_seed (aatv, params->seed);
+
+  colors_changed = params->color_text_bold != current->color_text_bold ||
+      params->color_text_normal != current->color_text_normal ||
+      params->color_text_dim != current->color_text_dim ||
+      params->color_rain_bold != current->color_rain_bold ||
+      params->color_rain_normal != current->color_rain_normal ||
+      params->color_rain_dim != current->color_rain_dim ||
+      params->color_background != current->color_background;
+  budget_changed = params->frame_budget != current->frame_budget;
+  rain_changed = params->rain_mode != current->rain_mode;
+
+  *current = *params;
+  g_slice_free (GstAATvParams, params);
+
+  if (colors_changed)
+    gst_aatv_update_palette (aatv);
+
+  /* the droplets run along the other axis now */
+  if (rain_changed)
+    gst_aatv_rain_reset (aatv);
+
+  if (budget_changed) {
+    gint width = g_atomic_int_get (&aatv->width);
+    gint height = g_atomic_int_get (&aatv->height);
+
+    aatv->frame_time = 0;
+    /* back to the full canvas when turned off */
+    if (current->frame_budget == 0 && (aatv->ascii_surf.width != width ||
+            aatv->ascii_surf.height != height))
+      gst_aatv_submit_canvas (aatv, gst_aatv_request_canvas (aatv, width,
+              height), FALSE);
+  }
+
+  /* frames drawn with the old settings don't count */
+  gst_aatv_invalidate (aatv);
+}
+
+/* keeps the smoothed lit fraction, and publishes it for the
+ * brightness-actual property */
+static void
+gst_aatv_set_lit (GstAATv * aatv, gfloat lit)
+{
+  gint bits;
+
+  aatv->lit_percentage = lit;
+  memcpy (&bits, &lit, sizeof (bits));
+  g_atomic_int_set (&aatv->lit_published, bits);
+}
+
+/* moves the brightness one step towards the target range */
+static void
+gst_aatv_update_brightness (GstAATv * aatv)
+{
+  if (aatv->params.auto_brightness &&
+      aatv->params.brightness_mode == GST_AATV_BRIGHTNESS_STEP) {
+    if (aatv->lit_percentage > aatv->params.brightness_target_max)
+      if (aatv->bright > -254)
+        g_atomic_int_set (&aatv->bright, aatv->bright - 1);
+    if (aatv->lit_percentage < aatv->params.brightness_target_min)
+      if (aatv->bright < 254)
+        g_atomic_int_set (&aatv->bright, aatv->bright + 1);
+  }
+}
+
+/* picks the brightness for the frame just scaled from its histogram. The
+ * lit fraction is predicted as the mean level of the toned image times the
+ * gain the last frames showed between the two, the brightness stays while
+ * that is in the target range and otherwise aims at the middle of it. */
+static void
+gst_aatv_expose (GstAATv * aatv)
+{
+  GstAAScaler *scaler = aatv->scaler;
+  gfloat target_min = aatv->params.brightness_target_min /
+      aatv->exposure_gain;
+  gfloat target_max = aatv->params.brightness_target_max /
+      aatv->exposure_gain;
+  gfloat target = (target_min + target_max) / 2;
+  gfloat level = gst_aa_scaler_get_level (scaler, aatv->bright);
+  gboolean inverted;
+  gint lower = 0, upper = 2 * 254;
+
+  if (level < target_min || level > target_max) {
+    /* the level only ever goes one way with the brightness, search for
+     * the first brightness reaching the target */
+    inverted = gst_aa_scaler_get_level (scaler, -254) >
+        gst_aa_scaler_get_level (scaler, 254);
+    while (lower < upper) {
+      gint middle = (lower + upper) / 2;
+
+      if ((gst_aa_scaler_get_level (scaler, middle - 254) < target) !=
+          inverted)
+        lower = middle + 1;
+      else
+        upper = middle;
+    }
+    g_atomic_int_set (&aatv->bright, lower - 254);
+    level = gst_aa_scaler_get_level (scaler, aatv->bright);
+  }
+
+  aatv->exposure_level = level;
+}
+
+/* one horizontal slice of character rows (or of chroma rows), rendered by
+ * one worker */
+typedef struct
+{
+  GstAATv *aatv;
+  GstVideoFrame *frame;
+  GstAATvCells *cells;
+  gboolean redraw;
+  guint row_start;
+  guint row_end;
+  gboolean stream;
+  guint lit_pixels;
+} GstAATvRenderTask;
+
+static void
+gst_aatv_render_rows (GstAATvRenderTask * task)
+{
+  GstAATv *aatv = task->aatv;
+  guint x, y, font_y;
+  guint lit_pixels = 0;
+  guint char_index;
+  guint chunk, n_cells;
+  guint8 glyphs[GST_AATV_RENDER_CHUNK];
+
+  guchar attribute;
+  guint8 color_class;
+
+  const guchar *text = aa_text (aatv->context);
+  const guchar *attrs = aa_attrs (aatv->context);
+  guint width = aa_scrwidth (aatv->context);
+
+  const guchar *font_base_address = aa_currentfont (aatv->context)->data;
+  guint font_height = aa_currentfont (aatv->context)->height;
+
+  GstAATvCells *cells = task->cells;
+  guint8 *plane = NULL;
+  gint stride = 0;
+  guint span = 8 * aatv->palette.pstride;
+  gboolean row_dirty;
+
+  /* without a frame only the classes and the lit pixels are needed */
+  if (task->frame != NULL) {
+    plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 0);
+    stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 0);
+  }
+
+  /* pick the color class of every cell once, rain is decided per cell */
+  char_index = task->row_start * width;
+  for (y = task->row_start; y < task->row_end; y++) {
+    for (x = 0; x < width; x++, char_index++) {
+      /* check for special attributes like bold or dimmed */
+      attribute = attrs[char_index];
+      if (attribute == AA_DIM)
+        color_class = GST_AATV_CLASS_TEXT_DIM;
+      else if (attribute == AA_BOLD)
+        color_class = GST_AATV_CLASS_TEXT_BOLD;
+      else
+        color_class = GST_AATV_CLASS_TEXT_NORMAL;
+
+      /* the rain classes follow the text ones in the same order */
+      aatv->cell_classes[char_index] = color_class +
+          aatv->rain_mask[char_index];
+
+      lit_pixels += aatv->glyph_lit[text[char_index]];
+    }
+  }
+  task->lit_pixels = lit_pixels;
+
+  if (plane == NULL)
+    return;
+
+  /* loop through the canvas height */
+  for (y = task->row_start; y < task->row_end; y++) {
+    const guchar *row_text = text + y * width;
+    const guint8 *row_classes = aatv->cell_classes + y * width;
+    guint8 *row_dirty_cells = aatv->cell_dirty + y * width;
+
+    /* compare against what the output memory already shows */
+    if (cells == NULL || task->redraw) {
+      memset (row_dirty_cells, 1, width);
+      row_dirty = TRUE;
+    } else {
+      row_dirty = FALSE;
+      for (x = 0; x < width; x++) {
+        row_dirty_cells[x] = row_text[x] != cells->text[y * width + x] ||
+            row_classes[x] != cells->classes[y * width + x];
+        row_dirty |= row_dirty_cells[x];
+      }
+    }
+    if (cells != NULL) {
+      memcpy (cells->text + y * width, row_text, width);
+      memcpy (cells->classes + y * width, row_classes, width);
+    }
+    if (!row_dirty)
+      continue;
+
+    /* loop through the height of a character's font */
+    for (font_y = 0; font_y < font_height; font_y++) {
+      const guchar *font_row = font_base_address + font_y;
+      guint8 *dest = plane + (gsize) (y * font_height + font_y) * stride;
+
+      /* loop through the canvas width, one 8 pixel span per character */
+      for (chunk = 0; chunk < width; chunk += n_cells) {
+        n_cells = MIN (width - chunk, GST_AATV_RENDER_CHUNK);
+
+        /* look the characters up in the font glyph table */
+        for (x = 0; x < n_cells; x++)
+          glyphs[x] = font_row[row_text[chunk + x] * font_height];
+
+        /* draw every run of changed cells */
+        for (x = 0; x < n_cells;) {
+          guint run_start;
+
+          if (!row_dirty_cells[chunk + x]) {
+            x++;
+            continue;
+          }
+          for (run_start = x; x < n_cells && row_dirty_cells[chunk + x]; x++);
+
+          aatv->render_row (dest + run_start * span, glyphs + run_start,
+              row_classes + chunk + run_start, x - run_start,
+              &aatv->palette, task->stream);
         }
+        dest += n_cells * span;
       }
-    } else {
-      raindrops[i].delay_counter++;
-      if (raindrops[i].delay_counter > raindrops[i].delay) {
-        raindrops[i].delay_counter = 0;
-        raindrops[i].location++;
+    }
+  }
+
+  /* every worker orders its own streaming stores */
+  if (task->stream)
+    gst_aatv_render_stream_fence ();
+}
+
+/* fills the chroma rows of I420 and NV12 output. Runs after all character
+ * rows are done since a pair of pixel rows can span two character rows. */
+static void
+gst_aatv_render_chroma_rows (GstAATvRenderTask * task)
+{
+  GstAATv *aatv = task->aatv;
+  guint x, y, chunk, n_cells;
+  guint8 glyphs0[GST_AATV_RENDER_CHUNK];
+  guint8 glyphs1[GST_AATV_RENDER_CHUNK];
+  guint8 dirty[GST_AATV_RENDER_CHUNK];
+
+  const guchar *text = aa_text (aatv->context);
+  guint width = aa_scrwidth (aatv->context);
+  guint height = GST_VIDEO_FRAME_HEIGHT (task->frame);
+
+  const guchar *font_base_address = aa_currentfont (aatv->context)->data;
+  guint font_height = aa_currentfont (aatv->context)->height;
+
+  guint8 *u_plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 1);
+  guint8 *v_plane;
+  gint u_stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 1);
+  gint v_stride;
+  guint pstride;
+
+  if (GST_VIDEO_FRAME_FORMAT (task->frame) == GST_VIDEO_FORMAT_NV12) {
+    v_plane = u_plane + 1;
+    v_stride = u_stride;
+    pstride = 2;
+  } else {
+    v_plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 2);
+    v_stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 2);
+    pstride = 1;
+  }
+
+  for (y = task->row_start; y < task->row_end; y++) {
+    guint y0 = 2 * y;
+    guint y1 = MIN (y0 + 1, height - 1);
+    guint row0 = y0 / font_height * width;
+    guint row1 = y1 / font_height * width;
+    const guchar *font_row0 = font_base_address + y0 % font_height;
+    const guchar *font_row1 = font_base_address + y1 % font_height;
+    guint8 *u = u_plane + (gsize) y * u_stride;
+    guint8 *v = v_plane + (gsize) y * v_stride;
+
+    for (chunk = 0; chunk < width; chunk += n_cells) {
+      n_cells = MIN (width - chunk, GST_AATV_RENDER_CHUNK);
+
+      for (x = 0; x < n_cells; x++) {
+        glyphs0[x] = font_row0[text[row0 + chunk + x] * font_height];
+        glyphs1[x] = font_row1[text[row1 + chunk + x] * font_height];
+        dirty[x] = aatv->cell_dirty[row0 + chunk + x] |
+            aatv->cell_dirty[row1 + chunk + x];
+      }
+
+      for (x = 0; x < n_cells;) {
+        guint run_start;
+
+        if (!dirty[x]) {
+          x++;
+          continue;
+        }
+        for (run_start = x; x < n_cells && dirty[x]; x++);
+
+        /* 4 chroma samples per cell */
+        gst_aatv_render_chroma_row (u + (chunk + run_start) * 4 * pstride,
+            v + (chunk + run_start) * 4 * pstride, pstride,
+            glyphs0 + run_start,
+            aatv->cell_classes + row0 + chunk + run_start,
+            glyphs1 + run_start,
+            aatv->cell_classes + row1 + chunk + run_start,
+            x - run_start, &aatv->palette);
       }
-      if (raindrops[i].location - raindrops[i].length > aatv->rain_height) {
-        raindrops[i].enabled = FALSE;
+    }
+  }
+}
+
+static void
+gst_aatv_stage_done (GstAATv * aatv, GstAATvStage stage, GstClockTime start,
+    GstClockTime end);
+
+/* works out which canvas pixel every output column and row of a stretched
+ * canvas lands on, once per canvas and frame size */
+static void
+gst_aatv_update_scaled_maps (GstAATv * aatv, guint out_width,
+    guint out_height)
+{
+  guint width = aa_scrwidth (aatv->context);
+  guint height = aa_scrheight (aatv->context);
+  guint font_height = aa_currentfont (aatv->context)->height;
+  guint i;
+
+  if (aatv->scaled_out_width == out_width &&
+      aatv->scaled_out_height == out_height && aatv->scaled_width == width &&
+      aatv->scaled_height == height && aatv->scaled_font_height == font_height)
+    return;
+
+  aatv->scaled_columns = g_renew (guint, aatv->scaled_columns, out_width);
+  aatv->scaled_rows = g_renew (guint, aatv->scaled_rows, out_height);
+  aatv->scaled_glyph_rows = g_renew (guint, aatv->scaled_glyph_rows,
+      out_height);
+
+  for (i = 0; i < out_width; i++)
+    aatv->scaled_columns[i] = (guint64) i * width * 8 / out_width;
+  for (i = 0; i < out_height; i++) {
+    guint src_y = (guint64) i * height * font_height / out_height;
+
+    aatv->scaled_rows[i] = src_y / font_height * width;
+    aatv->scaled_glyph_rows[i] = src_y % font_height;
+  }
+
+  aatv->scaled_out_width = out_width;
+  aatv->scaled_out_height = out_height;
+  aatv->scaled_width = width;
+  aatv->scaled_height = height;
+  aatv->scaled_font_height = font_height;
+}
+
+/* whether canvas pixel src_x of the glyph row at row, glyph_row is lit, and
+ * the color class of its cell */
+static inline gboolean
+gst_aatv_scaled_pixel (GstAATv * aatv, const guchar * text,
+    const guchar * font_base_address, guint font_height, guint row,
+    guint glyph_row, guint src_x, guint8 * color_class)
+{
+  guint cell = row + src_x / 8;
+  guint8 glyph = font_base_address[text[cell] * font_height + glyph_row];
+
+  *color_class = aatv->cell_classes[cell];
+  return (glyph >> (src_x % 8)) & 1;
+}
+
+/* draws the canvas stretched over the first plane, used while the frame
+ * budget keeps it smaller than the negotiated frame. Every output pixel
+ * takes the glyph pixel it lands on. */
+static void
+gst_aatv_render_scaled_rows (GstAATvRenderTask * task)
+{
+  GstAATv *aatv = task->aatv;
+  const guchar *text = aa_text (aatv->context);
+  const guchar *font_base_address = aa_currentfont (aatv->context)->data;
+  guint font_height = aa_currentfont (aatv->context)->height;
+  guint out_width = GST_VIDEO_FRAME_WIDTH (task->frame);
+  guint8 *plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 0);
+  gint stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 0);
+  guint pstride = aatv->palette.pstride;
+  guint x, y;
+
+  for (y = task->row_start; y < task->row_end; y++) {
+    guint row = aatv->scaled_rows[y];
+    guint glyph_row = aatv->scaled_glyph_rows[y];
+    guint8 *dest = plane + (gsize) y * stride;
+
+    for (x = 0; x < out_width; x++) {
+      guint8 color_class;
+      gboolean lit = gst_aatv_scaled_pixel (aatv, text, font_base_address,
+          font_height, row, glyph_row, aatv->scaled_columns[x], &color_class);
+      /* the all lit or all unlit span of the cell's color */
+      guint span = color_class * 256 + (lit ? 255 : 0);
+
+      memcpy (dest, aatv->palette.spans + span * 8 * pstride, pstride);
+      dest += pstride;
+    }
+  }
+}
+
+/* chroma planes of a stretched canvas, each sample averages the 2x2 output
+ * pixels it covers */
+static void
+gst_aatv_render_scaled_chroma_rows (GstAATvRenderTask * task)
+{
+  GstAATv *aatv = task->aatv;
+  const guchar *text = aa_text (aatv->context);
+  const guchar *font_base_address = aa_currentfont (aatv->context)->data;
+  guint font_height = aa_currentfont (aatv->context)->height;
+  guint out_width = GST_VIDEO_FRAME_WIDTH (task->frame);
+  guint out_height = GST_VIDEO_FRAME_HEIGHT (task->frame);
+  guint8 *u_plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 1);
+  guint8 *v_plane;
+  gint u_stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 1);
+  gint v_stride;
+  guint pstride;
+  guint x, y, i;
+
+  if (GST_VIDEO_FRAME_FORMAT (task->frame) == GST_VIDEO_FORMAT_NV12) {
+    v_plane = u_plane + 1;
+    v_stride = u_stride;
+    pstride = 2;
+  } else {
+    v_plane = GST_VIDEO_FRAME_PLANE_DATA (task->frame, 2);
+    v_stride = GST_VIDEO_FRAME_PLANE_STRIDE (task->frame, 2);
+    pstride = 1;
+  }
+
+  for (y = task->row_start; y < task->row_end; y++) {
+    guint py[2] = { 2 * y, MIN (2 * y + 1, out_height - 1) };
+    guint8 *u = u_plane + (gsize) y * u_stride;
+    guint8 *v = v_plane + (gsize) y * v_stride;
+
+    for (x = 0; x < (out_width + 1) / 2; x++) {
+      guint px[2] = { 2 * x, MIN (2 * x + 1, out_width - 1) };
+      guint u_sum = 0, v_sum = 0;
+
+      for (i = 0; i < 4; i++) {
+        guint8 color_class;
+        guint bits = gst_aatv_scaled_pixel (aatv, text, font_base_address,
+            font_height, aatv->scaled_rows[py[i >> 1]],
+            aatv->scaled_glyph_rows[py[i >> 1]],
+            aatv->scaled_columns[px[i & 1]], &color_class) ? 3 : 0;
+
+        /* the tables hold the sum of two pixels */
+        u_sum += aatv->palette.chroma_u[color_class][bits];
+        v_sum += aatv->palette.chroma_v[color_class][bits];
       }
+      *u = (u_sum + 4) >> 3;
+      *v = (v_sum + 4) >> 3;
+      u += pstride;
+      v += pstride;
     }
   }
 }
 
-static void
-gst_aatv_render (GstAATv * aatv, gint32 * dest)
+/* splits n_rows evenly across the workers and runs func on them */
+static void
+gst_aatv_render_split (GstAATv * aatv, GstAATvRenderTask * tasks,
+    gpointer * task_data, guint n_rows, GstAATaskFunc func)
+{
+  guint n_tasks, i;
+
+  n_tasks = MIN (gst_aa_task_runner_get_n_threads (aatv->task_runner),
+      MAX (n_rows, 1));
+  for (i = 0; i < n_tasks; i++) {
+    tasks[i].row_start = n_rows * i / n_tasks;
+    tasks[i].row_end = n_rows * (i + 1) / n_tasks;
+    task_data[i] = &tasks[i];
+  }
+
+  gst_aa_task_runner_run (aatv->task_runner, func, task_data, n_tasks);
+}
+
+static void
+gst_aatv_render (GstAATv * aatv, GstVideoFrame * frame, GstAATvCells * cells)
+{
+  GstAATvRenderTask *tasks;
+  gpointer *task_data;
+  guint lit_pixels = 0;
+  gfloat lit;
+  guint height = aa_scrheight (aatv->context);
+  guint n_threads, i;
+  gboolean stream, redraw, scaled;
+  gint epoch = g_atomic_int_get (&aatv->epoch);
+  GstClockTime start = gst_util_get_timestamp ();
+
+  /* the canvas doesn't match the frame while the budget scales it down */
+  scaled = frame != NULL &&
+      (aa_scrwidth (aatv->context) * 8 != GST_VIDEO_FRAME_WIDTH (frame) ||
+      height * aa_currentfont (aatv->context)->height !=
+      GST_VIDEO_FRAME_HEIGHT (frame));
+  if (scaled)
+    cells = NULL;
+
+  redraw = cells == NULL || cells->epoch != epoch;
+
+  n_threads = gst_aa_task_runner_get_n_threads (aatv->task_runner);
+  tasks = g_newa (GstAATvRenderTask, n_threads);
+  task_data = g_newa (gpointer, n_threads);
+
+  stream = frame != NULL && !scaled &&
+      (gsize) GST_VIDEO_FRAME_PLANE_STRIDE (frame, 0) *
+      GST_VIDEO_FRAME_HEIGHT (frame) >= GST_AATV_STREAM_THRESHOLD;
+
+  for (i = 0; i < n_threads; i++) {
+    tasks[i].aatv = aatv;
+    /* a scaled frame is drawn in its own pass */
+    tasks[i].frame = scaled ? NULL : frame;
+    tasks[i].cells = cells;
+    tasks[i].redraw = redraw;
+    tasks[i].stream = stream;
+    tasks[i].lit_pixels = 0;
+  }
+
+  /* character rows, these also classify the cells */
+  gst_aatv_render_split (aatv, tasks, task_data, height,
+      (GstAATaskFunc) gst_aatv_render_rows);
+
+  for (i = 0; i < n_threads; i++) {
+    lit_pixels += tasks[i].lit_pixels;
+    tasks[i].frame = frame;
+  }
+
+  if (scaled) {
+    gst_aatv_update_scaled_maps (aatv, GST_VIDEO_FRAME_WIDTH (frame),
+        GST_VIDEO_FRAME_HEIGHT (frame));
+    gst_aatv_render_split (aatv, tasks, task_data,
+        GST_VIDEO_FRAME_HEIGHT (frame),
+        (GstAATaskFunc) gst_aatv_render_scaled_rows);
+  }
+
+  if (frame != NULL && gst_aatv_palette_has_chroma (&aatv->palette))
+    gst_aatv_render_split (aatv, tasks, task_data,
+        (GST_VIDEO_FRAME_HEIGHT (frame) + 1) / 2, scaled ?
+        (GstAATaskFunc) gst_aatv_render_scaled_chroma_rows :
+        (GstAATaskFunc) gst_aatv_render_chroma_rows);
+
+  if (cells != NULL)
+    cells->epoch = epoch;
+
+  gst_aatv_stage_done (aatv, GST_AATV_STAGE_RENDER, start,
+      gst_util_get_timestamp ());
+
+  lit = (gfloat) lit_pixels / (aa_scrwidth (aatv->context) * height * 8 *
+      aa_currentfont (aatv->context)->height);
+  gst_aatv_set_lit (aatv, 0.2 * (aatv->lit_percentage) + 0.8 * lit);
+
+  /* how far off the prediction of gst_aatv_expose() was */
+  if (aatv->exposure_level > GST_AATV_EXPOSURE_MIN_LEVEL)
+    aatv->exposure_gain = CLAMP (0.25 * aatv->exposure_gain +
+        0.75 * lit / aatv->exposure_level, GST_AATV_EXPOSURE_MIN_GAIN,
+        GST_AATV_EXPOSURE_MAX_GAIN);
+  aatv->exposure_level = 0;
+
+  gst_aatv_update_brightness (aatv);
+}
+
+/* steps the canvas size towards what fits into the frame budget, between
+ * min-width x min-height and the negotiated size. Called with the time the
+ * last frame took. */
+static void
+gst_aatv_adapt_canvas (GstAATv * aatv, GstClockTime elapsed)
+{
+  gint width = aatv->ascii_surf.width;
+  gint height = aatv->ascii_surf.height;
+  gint max_width = g_atomic_int_get (&aatv->width);
+  gint max_height = g_atomic_int_get (&aatv->height);
+  gint min_width = MIN (aatv->params.min_width, max_width);
+  gint min_height = MIN (aatv->params.min_height, max_height);
+
+  if (aatv->params.frame_budget == 0)
+    return;
+
+  /* smooth out single slow frames */
+  if (aatv->frame_time == 0)
+    aatv->frame_time = elapsed;
+  else
+    aatv->frame_time = (3 * aatv->frame_time + elapsed) / 4;
+
+  /* let the average settle on the new size before the next step */
+  if (aatv->budget_settle > 0) {
+    aatv->budget_settle--;
+    return;
+  }
+
+  if (aatv->frame_time > aatv->params.frame_budget) {
+    width = MAX (min_width, width * 7 / 8);
+    height = MAX (min_height, height * 7 / 8);
+  } else if (aatv->frame_time < aatv->params.frame_budget / 8 * 5) {
+    /* an eighth more in both directions costs about a quarter more time,
+     * which still fits */
+    width = MIN (max_width, width + MAX (1, width / 8));
+    height = MIN (max_height, height + MAX (1, height / 8));
+  }
+
+  if (width == aatv->ascii_surf.width && height == aatv->ascii_surf.height)
+    return;
+
+  GST_DEBUG_OBJECT (aatv, "frame time %" GST_TIME_FORMAT ", canvas %dx%d",
+      GST_TIME_ARGS (aatv->frame_time), width, height);
+
+  gst_aatv_submit_canvas (aatv, gst_aatv_request_canvas (aatv, width,
+          height), FALSE);
+
+  /* no further steps until the new size is in use */
+  aatv->frame_time = 0;
+  aatv->budget_settle = GST_AATV_BUDGET_SETTLE;
+}
+
+/* (re)create the worker pool when n-threads changed */
+static void
+gst_aatv_update_task_runner (GstAATv * aatv)
+{
+  guint n_threads =
+      gst_aa_task_runner_resolve_n_threads (aatv->params.n_threads);
+
+  if (aatv->task_runner != NULL &&
+      gst_aa_task_runner_get_n_threads (aatv->task_runner) == n_threads)
+    return;
+
+  if (aatv->task_runner != NULL)
+    gst_aa_task_runner_free (aatv->task_runner);
+  aatv->task_runner = gst_aa_task_runner_new (n_threads);
+}
+
+/* copies the character grid of the current frame */
+static void
+gst_aatv_fill_cells (GstAATv * aatv, guint8 * text, guint8 * attrs,
+    guint8 * flags)
+{
+  guint n_cells = aa_scrwidth (aatv->context) * aa_scrheight (aatv->context);
+  guint i;
+
+  memcpy (text, aa_text (aatv->context), n_cells);
+  memcpy (attrs, aa_attrs (aatv->context), n_cells);
+  for (i = 0; i < n_cells; i++)
+    flags[i] = aatv->cell_classes[i] >= GST_AATV_CLASS_RAIN_NORMAL ?
+        GST_AATV_CELL_RAIN : 0;
+}
+
+/* GstBaseTransform calls this for every buffer, also the ones QoS drops
+ * right after, so the rain and the auto-brightness keep moving with the
+ * frame rate of the stream instead of the rate frames get rendered at */
+static void
+gst_aatv_before_transform (GstBaseTransform * trans, GstBuffer * buffer)
+{
+  GstAATv *aatv = GST_AATV (trans);
+  gboolean dropped = aatv->frame_pending;
+  guint i;
+
+  /* the frame time covers the rain too */
+  aatv->frame_start = gst_util_get_timestamp ();
+  if (dropped)
+    aatv->frames_dropped++;
+  aatv->frame_pending = TRUE;
+  for (i = 0; i < GST_AATV_N_STAGES; i++)
+    aatv->stage_times[i] = GST_CLOCK_TIME_NONE;
+
+  /* the settings and the canvas only ever change between frames */
+  gst_aatv_update_params (aatv);
+  gst_aatv_update_canvas (aatv);
+
+  /* the previous frame never got to transform, step the brightness with
+   * the last measured lit percentage */
+  if (dropped)
+    gst_aatv_update_brightness (aatv);
+
+  if (aatv->params.rain_mode != GST_RAIN_OFF) {
+    GstClockTime start = gst_util_get_timestamp ();
+
+    gst_aatv_rain (aatv);
+    gst_aatv_stage_done (aatv, GST_AATV_STAGE_RAIN, start,
+        gst_util_get_timestamp ());
+  }
+}
+
+static const gchar *stage_names[GST_AATV_N_STAGES] = {
+  "rain", "scale", "match", "render", "frame"
+};
+
+/* notes the time of a stage for the stats property and hands it to the aatv
+ * tracer */
+static void
+gst_aatv_stage_done (GstAATv * aatv, GstAATvStage stage, GstClockTime start,
+    GstClockTime end)
+{
+  aatv->stage_times[stage] = end - start;
+  gst_aa_trace_stage (GST_ELEMENT (aatv), stage_names[stage], start, end);
+}
+
+/* turns the input frame into characters */
+static void
+gst_aatv_convert (GstAATv * aatv, GstVideoFrame * in_frame)
+{
+  struct aa_renderparams ascii_parms = aatv->params.ascii_parms;
+  struct aa_renderparams render_parms;
+  GstClockTime start, end;
+  gboolean expose = aatv->params.auto_brightness &&
+      aatv->params.brightness_mode == GST_AATV_BRIGHTNESS_HISTOGRAM;
+
+  gst_aatv_update_task_runner (aatv);
+  ascii_parms.bright = aatv->bright;
+  gst_aa_scaler_set_tone (aatv->scaler, &ascii_parms, &render_parms);
+  gst_aa_scaler_set_defer_tone (aatv->scaler, expose);
+
+  start = gst_util_get_timestamp ();
+  gst_aa_scaler_set_format (aatv->scaler, GST_VIDEO_FRAME_FORMAT (in_frame));
+  gst_aa_scaler_scale (aatv->scaler, GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0),  /* src */
+      GST_VIDEO_FRAME_WIDTH (in_frame), /* sw */
+      GST_VIDEO_FRAME_HEIGHT (in_frame),        /* sh */
+      GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0),       /* ss */
+      aa_image (aatv->context), /* dest */
+      aa_imgwidth (aatv->context),      /* dw */
+      aa_imgheight (aatv->context));    /* dh */
+  if (expose) {
+    gst_aatv_expose (aatv);
+    ascii_parms.bright = aatv->bright;
+    gst_aa_scaler_set_tone (aatv->scaler, &ascii_parms, &render_parms);
+    gst_aa_scaler_apply_tone (aatv->scaler, aa_image (aatv->context),
+        aa_imgwidth (aatv->context) * aa_imgheight (aatv->context));
+  }
+  end = gst_util_get_timestamp ();
+  gst_aatv_stage_done (aatv, GST_AATV_STAGE_SCALE, start, end);
+
+  gst_aa_render_bands (aatv->task_runner, aatv->context, &render_parms);
+  gst_aatv_stage_done (aatv, GST_AATV_STAGE_MATCH, end,
+      gst_util_get_timestamp ());
+}
+
+/* the stats property and message */
+static GstStructure *
+gst_aatv_get_stats (const GstAATvStatsSnapshot * snapshot)
+{
+  GstStructure *s;
+  guint i;
+
+  s = gst_structure_new ("aatv-stats",
+      "frames", G_TYPE_UINT64, snapshot->stats[GST_AATV_STAGE_FRAME].count,
+      "frames-dropped", G_TYPE_UINT64, snapshot->frames_dropped,
+      "columns", G_TYPE_INT, snapshot->columns,
+      "rows", G_TYPE_INT, snapshot->rows, NULL);
+
+  for (i = 0; i < GST_AATV_N_STAGES; i++)
+    gst_aa_stats_set_fields (&snapshot->stats[i], s, stage_names[i]);
+
+  return s;
+}
+
+/* copies the stats of the streaming thread into a snapshot the getters can
+ * read, reusing the one the last publish replaced */
+static GstAATvStatsSnapshot *
+gst_aatv_snapshot_stats (GstAATv * aatv)
+{
+  GstAATvStatsSnapshot *snapshot = aatv->stats_spare;
+
+  if (snapshot == NULL)
+    snapshot = g_slice_new (GstAATvStatsSnapshot);
+  aatv->stats_spare = NULL;
+
+  memcpy (snapshot->stats, aatv->stats, sizeof (aatv->stats));
+  snapshot->frames_dropped = aatv->frames_dropped;
+  snapshot->columns = aatv->ascii_surf.width;
+  snapshot->rows = aatv->ascii_surf.height;
+
+  return snapshot;
+}
+
+/* makes snapshot the one the getters see. The replaced one is kept for the
+ * next snapshot, unless a getter is reading it right now, then the getter
+ * frees it. */
+static void
+gst_aatv_publish_stats (GstAATv * aatv, GstAATvStatsSnapshot * snapshot)
+{
+  GstAATvStatsSnapshot *old;
+
+  do {
+    old = g_atomic_pointer_get (&aatv->stats_published);
+  } while (!g_atomic_pointer_compare_and_exchange (&aatv->stats_published,
+          old, snapshot));
+
+  aatv->stats_spare = old;
+}
+
+/* reads the last published stats, as a structure and/or the dropped frame
+ * count. Called with the object lock held so there is only one reader, the
+ * streaming thread never waits for it. */
+static void
+gst_aatv_read_stats (GstAATv * aatv, GstStructure ** stats,
+    guint64 * frames_dropped)
+{
+  GstAATvStatsSnapshot *snapshot;
+
+  do {
+    snapshot = g_atomic_pointer_get (&aatv->stats_published);
+  } while (snapshot != NULL &&
+      !g_atomic_pointer_compare_and_exchange (&aatv->stats_published,
+          snapshot, NULL));
+
+  /* init publishes the first one */
+  g_return_if_fail (snapshot != NULL);
+
+  if (stats != NULL)
+    *stats = gst_aatv_get_stats (snapshot);
+  if (frames_dropped != NULL)
+    *frames_dropped = snapshot->frames_dropped;
+
+  /* a newer one went out meanwhile */
+  if (!g_atomic_pointer_compare_and_exchange (&aatv->stats_published, NULL,
+          snapshot))
+    g_slice_free (GstAATvStatsSnapshot, snapshot);
+}
+
+/* called when a frame is done, returns the stats message to post if one is
+ * due */
+static GstMessage *
+gst_aatv_finish_frame (GstAATv * aatv)
+{
+  GstClockTime start = aatv->frame_start;
+  GstClockTime now = gst_util_get_timestamp ();
+  GstAATvStatsSnapshot *snapshot;
+  GstStructure *stats = NULL;
+  guint i;
+
+  if (!aatv->cells_output)
+    gst_aatv_adapt_canvas (aatv, now - start);
+
+  aatv->stage_times[GST_AATV_STAGE_FRAME] = now - start;
+
+  for (i = 0; i < GST_AATV_N_STAGES; i++)
+    if (GST_CLOCK_TIME_IS_VALID (aatv->stage_times[i]))
+      gst_aa_stats_add (&aatv->stats[i], aatv->stage_times[i]);
+
+  snapshot = gst_aatv_snapshot_stats (aatv);
+  if (aatv->params.stats_interval != 0 &&
+      now - aatv->stats_posted >= aatv->params.stats_interval) {
+    aatv->stats_posted = now;
+    stats = gst_aatv_get_stats (snapshot);
+  }
+  gst_aatv_publish_stats (aatv, snapshot);
+
+  if (stats == NULL)
+    return NULL;
+
+  return gst_message_new_element (GST_OBJECT (aatv), stats);
+}
+
+static GstFlowReturn
+gst_aatv_transform_frame (GstVideoFilter * vfilter, GstVideoFrame * in_frame,
+    GstVideoFrame * out_frame)
+{
+  GstAATv *aatv = GST_AATV (vfilter);
+  GstAATvCellsMeta *meta;
+  GstMessage *stats;
+
+  gst_aatv_convert (aatv, in_frame);
+  gst_aatv_render (aatv, out_frame, gst_aatv_get_cells (aatv,
+          out_frame->buffer));
+
+  meta = gst_buffer_add_aatv_cells_meta (out_frame->buffer,
+      aa_scrwidth (aatv->context), aa_scrheight (aatv->context),
+      aatv->ascii_font);
+  gst_aatv_fill_cells (aatv, meta->text, meta->attrs, meta->flags);
+
+  stats = gst_aatv_finish_frame (aatv);
+
+  if (stats != NULL)
+    gst_element_post_message (GST_ELEMENT (aatv), stats);
+
+  return GST_FLOW_OK;
+}
+
+/* the cells caps bypass GstVideoFilter, which only knows raw video */
+static GstFlowReturn
+gst_aatv_transform (GstBaseTransform * trans, GstBuffer * inbuf,
+    GstBuffer * outbuf)
 {
+  GstAATv *aatv = GST_AATV (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+  GstVideoFrame in_frame;
+  GstMapInfo map;
+  GstMessage *stats;
+  gsize n_cells;
+
+  /* only QoS skips transform, frames dropped or lost below aren't counted
+   * and don't step the brightness again */
+  aatv->frame_pending = FALSE;
+
+  if (!aatv->cells_output)
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->transform (trans, inbuf,
+        outbuf);
+
+  /* the canvas was resized and the caps for it aren't in place yet */
+  if (aa_scrwidth (aatv->context) != aatv->cells_width ||
+      aa_scrheight (aatv->context) != aatv->cells_height) {
+    GST_DEBUG_OBJECT (aatv, "dropping frame, canvas %dx%d doesn't match "
+        "caps %dx%d", aa_scrwidth (aatv->context),
+        aa_scrheight (aatv->context), aatv->cells_width, aatv->cells_height);
+    return GST_BASE_TRANSFORM_FLOW_DROPPED;
+  }
 
-  guint x, y, font_x, font_y;
-  guint background_pixels = 0;
-  guint foreground_pixels = 0;
-  guint char_index = 0;
-  guint dest_index = 0;
+  if (!gst_video_frame_map (&in_frame, &filter->in_info, inbuf, GST_MAP_READ))
+    goto invalid_buffer;
 
-  gchar input_letter, input_glyph, attribute;
-  gboolean rain_pixel;
+  if (!gst_buffer_map (outbuf, &map, GST_MAP_WRITE)) {
+    gst_video_frame_unmap (&in_frame);
+    goto invalid_buffer;
+  }
 
-  GstAATvDroplet *raindrops = aatv->raindrops;
+  gst_aatv_convert (aatv, &in_frame);
+  gst_aatv_render (aatv, NULL, NULL);
 
-  const guchar *font_base_address = aa_currentfont (aatv->context)->data;
-  guint font_height = aa_currentfont (aatv->context)->height;
+  n_cells = (gsize) aatv->cells_width * aatv->cells_height;
+  gst_aatv_fill_cells (aatv, map.data, map.data + n_cells,
+      map.data + 2 * n_cells);
 
-  /* loop through the canvas height */
-  for (y = 0; y < aa_scrheight (aatv->context); y++) {
-    /* loop through the height of a character's font */
-    for (font_y = 0; font_y < font_height; font_y++) {
-      /* loop through the canvas width */
-      for (x = 0; x < aa_scrwidth (aatv->context); x++) {
-
-        /* which char are we working on */
-        char_index = x + y * aa_scrwidth (aatv->context);
-        /* lookup what character we need to render */
-        input_letter = aa_text (aatv->context)[char_index];
-        /* check for special attributes like bold or dimmed */
-        attribute = aa_attrs (aatv->context)[char_index];
-        /* look that character up in the font glyph table */
-        input_glyph = font_base_address[input_letter * font_height + font_y];
-
-        /* check if we need to re-color this character for rain effect */
-        rain_pixel = FALSE;
-
-        if (aatv->rain_mode == GST_RAIN_DOWN) {
-          if (raindrops[x].enabled)
-            if (y <= raindrops[x].location)
-              if (y >= raindrops[x].location - raindrops[x].length)
-                rain_pixel = TRUE;
-        } else if (aatv->rain_mode == GST_RAIN_UP) {
-          if (raindrops[x].enabled)
-            if (aatv->rain_height - y <= raindrops[x].location)
-              if (aatv->rain_height - y >=
-                  raindrops[x].location - raindrops[x].length)
-                rain_pixel = TRUE;
-        } else if (aatv->rain_mode == GST_RAIN_LEFT) {
-          if (raindrops[y].enabled)
-            if (x <= raindrops[y].location)
-              if (x >= raindrops[y].location - raindrops[y].length)
-                rain_pixel = TRUE;
-        } else if (aatv->rain_mode == GST_RAIN_RIGHT) {
-          if (raindrops[y].enabled)
-            if (aatv->rain_height - x <= raindrops[y].location)
-              if (aatv->rain_height - x >=
-                  raindrops[y].location - raindrops[y].length)
-                rain_pixel = TRUE;
-        }
-        /* loop through the width of a character's font (always 8 pixels wide) */
-        for (font_x = 0; font_x < 8; font_x++) {
-          guint32 *pixel_argb;
-          if (CHECK_BIT (input_glyph, font_x)) {
-            if (attribute == AA_DIM) {
-              if (rain_pixel)
-                pixel_argb = &aatv->color_rain_dim;
-              else
-                pixel_argb = &aatv->color_text_dim;
-            } else if (attribute == AA_BOLD) {
-              if (rain_pixel)
-                pixel_argb = &aatv->color_rain_bold;
-              else
-                pixel_argb = &aatv->color_text_bold;
-            } else {
-              if (rain_pixel)
-                pixel_argb = &aatv->color_rain_normal;
-              else
-                pixel_argb = &aatv->color_text_normal;
-            }
-            foreground_pixels++;
-          } else {
-            pixel_argb = &aatv->color_background;
-            background_pixels++;
-          }
-          dest[dest_index++] = *pixel_argb;
-        }
-      }
-    }
-  }
+  stats = gst_aatv_finish_frame (aatv);
+
+  if (stats != NULL)
+    gst_element_post_message (GST_ELEMENT (aatv), stats);
 
-  aatv->lit_percentage =
-      0.2 * (aatv->lit_percentage) +
-      0.8 * (float) foreground_pixels / background_pixels;
+  gst_buffer_unmap (outbuf, &map);
+  gst_video_frame_unmap (&in_frame);
+
+  return GST_FLOW_OK;
 
-  if (aatv->auto_brightness) {
-    if (aatv->lit_percentage > aatv->brightness_target_max)
-      if (aatv->ascii_parms.bright > -254)
-        aatv->ascii_parms.bright--;
-    if (aatv->lit_percentage < aatv->brightness_target_min)
-      if (aatv->ascii_parms.bright < 254)
-        aatv->ascii_parms.bright++;
+  /* ERRORS */
+invalid_buffer:
+  {
+    GST_ELEMENT_WARNING (trans, CORE, NOT_IMPLEMENTED, (NULL),
+        ("invalid video buffer received"));
+    return GST_FLOW_OK;
   }
+}
 
+static gboolean
+gst_aatv_is_cells_caps (GstCaps * caps)
+{
+  return gst_structure_has_name (gst_caps_get_structure (caps, 0),
+      GST_AATV_CELLS_MEDIA_TYPE);
 }
 
-static GstFlowReturn
-gst_aatv_transform_frame (GstVideoFilter * vfilter, GstVideoFrame * in_frame,
-    GstVideoFrame * out_frame)
+static gboolean
+gst_aatv_set_caps (GstBaseTransform * trans, GstCaps * incaps,
+    GstCaps * outcaps)
 {
-  GstAATv *aatv = GST_AATV (vfilter);
+  GstAATv *aatv = GST_AATV (trans);
+  GstVideoFilter *filter = GST_VIDEO_FILTER (trans);
+  GstVideoInfo in_info;
 
-  if (aatv->rain_mode != GST_RAIN_OFF)
-    gst_aatv_rain (aatv);
+  aatv->cells_output = gst_aatv_is_cells_caps (outcaps);
+  if (!aatv->cells_output)
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->set_caps (trans, incaps,
+        outcaps);
 
-  GST_OBJECT_LOCK (aatv);
+  if (!gst_video_info_from_caps (&in_info, incaps) ||
+      !gst_structure_get_int (gst_caps_get_structure (outcaps, 0), "width",
+          &aatv->cells_width) ||
+      !gst_structure_get_int (gst_caps_get_structure (outcaps, 0), "height",
+          &aatv->cells_height))
+    return FALSE;
 
-  gst_aatv_scale (aatv, GST_VIDEO_FRAME_PLANE_DATA (in_frame, 0),       /* src */
-      aa_image (aatv->context), /* dest */
-      GST_VIDEO_FRAME_WIDTH (in_frame), /* sw */
-      GST_VIDEO_FRAME_HEIGHT (in_frame),        /* sh */
-      GST_VIDEO_FRAME_PLANE_STRIDE (in_frame, 0),       /* ss */
-      aa_imgwidth (aatv->context),      /* dw */
-      aa_imgheight (aatv->context));    /* dh */
+  filter->in_info = in_info;
+  gst_video_info_init (&filter->out_info);
+  filter->negotiated = TRUE;
 
-  aa_render (aatv->context, &aatv->ascii_parms, 0, 0,
-      aa_imgwidth (aatv->context), aa_imgheight (aatv->context));
-  gst_aatv_render (aatv, GST_VIDEO_FRAME_PLANE_DATA (out_frame, 0));
+  return TRUE;
+}
 
-  GST_OBJECT_UNLOCK (aatv);
+static gboolean
+gst_aatv_get_unit_size (GstBaseTransform * trans, GstCaps * caps,
+    gsize * size)
+{
+  GstStructure *structure;
+  gint width, height;
 
-  return GST_FLOW_OK;
+  if (!gst_aatv_is_cells_caps (caps))
+    return GST_BASE_TRANSFORM_CLASS (parent_class)->get_unit_size (trans,
+        caps, size);
+
+  structure = gst_caps_get_structure (caps, 0);
+  if (!gst_structure_get_int (structure, "width", &width) ||
+      !gst_structure_get_int (structure, "height", &height))
+    return FALSE;
+
+  /* characters, attributes and flags */
+  *size = 3 * (gsize) width * height;
+
+  return TRUE;
 }
 
 
@@ -429,19 +1563,61 @@ static gboolean
 gst_aatv_setcaps (GstVideoFilter * filter, GstCaps * incaps,
     GstVideoInfo * in_info, GstCaps * outcaps, GstVideoInfo * out_info)
 {
+  GstAATv *aatv = GST_AATV (filter);
+  GstVideoFormat format = GST_VIDEO_INFO_FORMAT (out_info);
+
+  if (aatv->palette.format != format) {
+    aatv->palette.format = format;
+    gst_aatv_update_palette (aatv);
+    aatv->render_row = gst_aatv_render_get_row_func (format, NULL);
+  }
+
+  gst_aatv_invalidate (aatv);
+
+  return TRUE;
+}
+
+/* every run starts with fresh stats, like aasink's */
+static gboolean
+gst_aatv_start (GstBaseTransform * trans)
+{
+  GstAATv *aatv = GST_AATV (trans);
+  guint i;
+
+  /* the streaming thread isn't running yet */
+  aatv->frame_pending = FALSE;
+  aatv->frames_dropped = 0;
+  aatv->stats_posted = 0;
+  for (i = 0; i < GST_AATV_N_STAGES; i++)
+    gst_aa_stats_reset (&aatv->stats[i]);
+  gst_aatv_publish_stats (aatv, gst_aatv_snapshot_stats (aatv));
 
   return TRUE;
 }
 
+static gboolean
+gst_aatv_sink_event (GstBaseTransform * trans, GstEvent * event)
+{
+  GstAATv *aatv = GST_AATV (trans);
+
+  if (GST_EVENT_TYPE (event) == GST_EVENT_FLUSH_STOP) {
+    gst_aatv_invalidate (aatv);
+    /* flushed frames weren't dropped */
+    aatv->frame_pending = FALSE;
+  }
+
+  return GST_BASE_TRANSFORM_CLASS (parent_class)->sink_event (trans, event);
+}
+
 /* use a custom transform_caps */
 static GstCaps *
 gst_aatv_transform_caps (GstBaseTransform * trans, GstPadDirection direction,
     GstCaps * caps, GstCaps * filter)
 {
-  GstCaps *ret;
+  GstCaps *ret, *templ, *tmp, *cells;
   GstAATv *aatv = GST_AATV (trans);
-  GValue formats = G_VALUE_INIT;
-  GValue value = G_VALUE_INIT;
+  gint columns, rows, font;
+  guint i;
   GValue src_width = G_VALUE_INIT;
   GValue src_height = G_VALUE_INIT;
 
@@ -453,24 +1629,59 @@ gst_aatv_transform_caps (GstBaseTransform * trans, GstPadDirection direction,
     g_value_init (&src_height, G_TYPE_INT);
     /* calculate output resolution from canvas size and font size */
 
-    g_value_set_int (&src_width, aa_defparams.width * 8);
-    g_value_set_int (&src_height,
-        aa_defparams.height * aa_currentfont (aatv->context)->height);
+    GST_OBJECT_LOCK (aatv);
+    columns = aatv->width;
+    rows = aatv->height;
+    font = aatv->font;
+    g_value_set_int (&src_width, columns * 8);
+    g_value_set_int (&src_height, rows * aa_fonts[font]->height);
+    GST_OBJECT_UNLOCK (aatv);
 
     gst_caps_set_value (ret, "width", &src_width);
     gst_caps_set_value (ret, "height", &src_height);
-    /* force RGBA output format */
-    g_value_init (&formats, GST_TYPE_LIST);
-    g_value_init (&value, G_TYPE_STRING);
-    g_value_set_string (&value, "RGBA");
-    gst_value_list_append_value (&formats, &value);
+    g_value_unset (&src_width);
+    g_value_unset (&src_height);
 
-    gst_caps_set_value (ret, "format", &formats);
+    /* output is one of the formats the palette is built for, in order of
+     * preference, the colorimetry of the input doesn't apply to it */
+    for (i = 0; i < gst_caps_get_size (ret); i++) {
+      GstStructure *structure = gst_caps_get_structure (ret, i);
+
+      gst_structure_remove_fields (structure, "format", "colorimetry",
+          "chroma-site", NULL);
+    }
+    templ = gst_static_pad_template_get_caps (&src_template_tv);
+    tmp = gst_caps_intersect_full (templ, ret, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (templ);
+    gst_caps_unref (ret);
+    ret = tmp;
+
+    /* the bare character grid comes last */
+    cells = gst_caps_new_empty ();
+    for (i = 0; i < gst_caps_get_size (caps); i++) {
+      const GValue *framerate =
+          gst_structure_get_value (gst_caps_get_structure (caps, i),
+          "framerate");
+      GstStructure *structure = gst_structure_new (GST_AATV_CELLS_MEDIA_TYPE,
+          "width", G_TYPE_INT, columns, "height", G_TYPE_INT, rows,
+          "font", G_TYPE_INT, font, NULL);
+
+      if (framerate)
+        gst_structure_set_value (structure, "framerate", framerate);
+      gst_caps_append_structure (cells, structure);
+    }
+    ret = gst_caps_merge (ret, cells);
 
   } else {
     ret = gst_static_pad_template_get_caps (&sink_template_tv);
   }
 
+  if (filter) {
+    tmp = gst_caps_intersect_full (filter, ret, GST_CAPS_INTERSECT_FIRST);
+    gst_caps_unref (ret);
+    ret = tmp;
+  }
+
   return ret;
 }
 
@@ -490,6 +1701,7 @@ gst_aatv_class_init (GstAATvClass * klass)
 
   gobject_class->set_property = gst_aatv_set_property;
   gobject_class->get_property = gst_aatv_get_property;
+  gobject_class->finalize = gst_aatv_finalize;
 
 
   g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_WIDTH,
@@ -537,8 +1749,15 @@ gst_aatv_class_init (GstAATvClass * klass)
           255, 0, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_BRIGHTNESS_AUTO,
       g_param_spec_boolean ("brightness-auto", "brightness-auto",
-          "Automatically adjust brightness based on the previous frame's foreground pixel fill percentage",
+          "Automatically adjust brightness to keep the foreground pixel fill percentage between brightness-min and brightness-max",
           TRUE, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_BRIGHTNESS_AUTO_MODE, g_param_spec_enum ("brightness-auto-mode",
+          "brightness-auto-mode",
+          "How brightness-auto moves the brightness: one step per frame, or "
+          "straight to the target from the histogram of the frame",
+          GST_TYPE_AATV_BRIGHTNESS_MODE, PROP_BRIGHTNESS_AUTO_MODE_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
   g_object_class_install_property (G_OBJECT_CLASS (klass),
       PROP_BRIGHTNESS_ACTUAL, g_param_spec_float ("brightness-actual",
           "brightness-actual",
@@ -609,6 +1828,56 @@ gst_aatv_class_init (GstAATvClass * klass)
           "Sets the dimmest brightness color to use for foreground ASCII text rain overlays (big-endian ARGB).",
           0, G_MAXUINT32, 0,
           G_PARAM_READWRITE | GST_PARAM_CONTROLLABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_N_THREADS,
+      g_param_spec_uint ("n-threads", "n-threads",
+          "Number of threads used to convert and render character rows (0 = number of cores)",
+          0, GST_AA_TASK_RUNNER_MAX_THREADS, PROP_N_THREADS_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_INCREMENTAL,
+      g_param_spec_boolean ("incremental", "incremental",
+          "Only redraw changed characters into recycled output buffers. "
+          "Leave disabled when a downstream element draws into aatv's "
+          "buffers in place",
+          PROP_INCREMENTAL_DEFAULT, G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_FRAMES_DROPPED,
+      g_param_spec_uint64 ("frames-dropped", "frames-dropped",
+          "Number of frames skipped because QoS reported them late", 0,
+          G_MAXUINT64, 0, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_FRAME_BUDGET,
+      g_param_spec_uint64 ("frame-budget", "frame-budget",
+          "Processing time per frame in nanoseconds, the canvas shrinks "
+          "down to min-width x min-height to stay within it while the "
+          "output size stays the same (0 = off)", 0, G_MAXUINT64,
+          PROP_FRAME_BUDGET_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_MIN_WIDTH,
+      g_param_spec_int ("min-width", "min-width",
+          "Smallest canvas width the frame budget may shrink to", 1,
+          G_MAXINT, PROP_MIN_WIDTH_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_MIN_HEIGHT,
+      g_param_spec_int ("min-height", "min-height",
+          "Smallest canvas height the frame budget may shrink to", 1,
+          G_MAXINT, PROP_MIN_HEIGHT_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_STATS,
+      g_param_spec_boxed ("stats", "stats",
+          "Last, mean and 99th percentile time in nanoseconds of the rain, "
+          "scale, match, render stages and of the whole frame",
+          GST_TYPE_STRUCTURE, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass),
+      PROP_STATS_INTERVAL, g_param_spec_uint64 ("stats-interval",
+          "stats-interval",
+          "Post the stats as an element message this often in nanoseconds "
+          "(0 = never)", 0, G_MAXUINT64, PROP_STATS_INTERVAL_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (G_OBJECT_CLASS (klass), PROP_SEED,
+      g_param_spec_uint ("seed", "seed",
+          "Seed of the rain's random numbers, setting it restarts the "
+          "sequence (0 = random)", 0, G_MAXUINT, PROP_SEED_DEFAULT,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  gst_aatv_cells_quark = g_quark_from_static_string ("GstAATvCells");
 
   gst_element_class_add_static_pad_template (gstelement_class,
       &sink_template_tv);
@@ -620,42 +1889,247 @@ gst_aatv_class_init (GstAATvClass * klass)
       "ASCII art effect", "Eric Marks <bigmarkslp@gmail.com>");
 
   transform_class->transform_caps = GST_DEBUG_FUNCPTR (gst_aatv_transform_caps);
+  transform_class->start = GST_DEBUG_FUNCPTR (gst_aatv_start);
+  transform_class->sink_event = GST_DEBUG_FUNCPTR (gst_aatv_sink_event);
+  transform_class->set_caps = GST_DEBUG_FUNCPTR (gst_aatv_set_caps);
+  transform_class->get_unit_size = GST_DEBUG_FUNCPTR (gst_aatv_get_unit_size);
+  transform_class->transform = GST_DEBUG_FUNCPTR (gst_aatv_transform);
+  transform_class->before_transform =
+      GST_DEBUG_FUNCPTR (gst_aatv_before_transform);
   videofilter_class->transform_frame =
       GST_DEBUG_FUNCPTR (gst_aatv_transform_frame);
   videofilter_class->set_info = GST_DEBUG_FUNCPTR (gst_aatv_setcaps);
 }
 
+/* sizes the droplets for the rain mode and canvas, all of them off */
 static void
-gst_aatv_rain_init (GstAATv * aatv)
+gst_aatv_rain_reset (GstAATv * aatv)
 {
-
-  switch (aatv->rain_mode) {
+  switch (aatv->params.rain_mode) {
     case GST_RAIN_DOWN:
     case GST_RAIN_UP:
-      aatv->rain_width = aa_defparams.width;
-      aatv->rain_height = aa_defparams.height;
+      aatv->rain_width = aatv->ascii_surf.width;
+      aatv->rain_height = aatv->ascii_surf.height;
       break;
     case GST_RAIN_LEFT:
     case GST_RAIN_RIGHT:
-      aatv->rain_width = aa_defparams.height;
-      aatv->rain_height = aa_defparams.width;
+      aatv->rain_width = aatv->ascii_surf.height;
+      aatv->rain_height = aatv->ascii_surf.width;
       break;
     case GST_RAIN_OFF:
       aatv->rain_width = 0;
       aatv->rain_height = 0;
   }
 
-  if (aatv->context != NULL)
-    aa_close (aatv->context);
-  aatv->context = aa_init (&mem_d, &aa_defparams, NULL);
-  aa_setfont (aatv->context, aa_fonts[0]);
-
   aatv->raindrops =
       realloc (aatv->raindrops,
       aatv->rain_width * sizeof (struct _GstAATvDroplet));
   for (gint i = 0; i < aatv->rain_width; i++)
     aatv->raindrops[i].enabled = FALSE;
+  aatv->rain_random = g_renew (guint32, aatv->rain_random, aatv->rain_width);
+  aatv->rain_active = g_renew (guint, aatv->rain_active, aatv->rain_width);
+  aatv->rain_n_active = 0;
+  memset (aatv->rain_mask, 0,
+      aa_scrwidth (aatv->context) * aa_scrheight (aatv->context));
+}
+
+static GstAATvCanvas *
+gst_aatv_canvas_new (gint width, gint height)
+{
+  GstAATvCanvas *canvas = g_slice_new0 (GstAATvCanvas);
+
+  memcpy (&canvas->surf, &aa_defparams, sizeof (struct aa_hardware_params));
+  canvas->surf.width = width;
+  canvas->surf.height = height;
+
+  return canvas;
+}
+
+/* creates the context for the size the canvas asks for in font. A font
+ * change bumps canvas_serial after setting the font, so a canvas built
+ * with the old one is never switched to. */
+static gboolean
+gst_aatv_canvas_build (GstAATvCanvas * canvas, gint font)
+{
+  canvas->font = font;
+  canvas->surf.font = aa_fonts[canvas->font];
+  canvas->context = aa_init (&mem_d, &canvas->surf, NULL);
+  if (canvas->context == NULL)
+    return FALSE;
+
+  aa_setfont (canvas->context, canvas->surf.font);
+  gst_aa_tables_attach (canvas->context);
+
+  return TRUE;
+}
+
+static void
+gst_aatv_canvas_free (GstAATvCanvas * canvas)
+{
+  if (canvas->context != NULL) {
+    gst_aa_tables_detach (canvas->context);
+    aa_close (canvas->context);
+  }
+  g_slice_free (GstAATvCanvas, canvas);
+}
+
+/* counts the lit pixels of every glyph of the context's font, the lit
+ * fraction of a frame is then a sum over its cells */
+static void
+gst_aatv_count_glyphs (GstAATv * aatv)
+{
+  const struct aa_font *font = aa_currentfont (aatv->context);
+  guint c;
+  gint y;
+
+  for (c = 0; c < 256; c++) {
+    guint lit = 0;
+
+    /* once per canvas, a plain bit loop is fast enough */
+    for (y = 0; y < font->height; y++) {
+      guint8 bits = font->data[c * font->height + y];
+
+      for (; bits != 0; bits &= bits - 1)
+        lit++;
+    }
+    aatv->glyph_lit[c] = lit;
+  }
+}
+
+/* renders with the context of canvas from now on, called by the streaming
+ * thread between frames */
+static void
+gst_aatv_set_canvas (GstAATv * aatv, GstAATvCanvas * canvas)
+{
+  gsize n_cells;
+
+  if (aatv->context != NULL) {
+    gst_aa_tables_detach (aatv->context);
+    aa_close (aatv->context);
+  }
+  aatv->context = canvas->context;
+  canvas->context = NULL;
+
+  aatv->ascii_surf = canvas->surf;
+  aatv->ascii_font = canvas->font;
+
+  gst_aatv_canvas_free (canvas);
+
+  gst_aatv_count_glyphs (aatv);
+
+  n_cells = (gsize) aa_scrwidth (aatv->context) * aa_scrheight (aatv->context);
+  aatv->cell_classes = g_renew (guint8, aatv->cell_classes, n_cells);
+  aatv->cell_dirty = g_renew (guint8, aatv->cell_dirty, n_cells);
+  aatv->rain_mask = g_renew (guint8, aatv->rain_mask, n_cells);
+
+  gst_aatv_rain_reset (aatv);
+  gst_aatv_invalidate (aatv);
+}
+
+/* hands a built canvas to the streaming thread unless a newer one was
+ * asked for meanwhile. A synchronous build and the canvas thread can both
+ * publish, the newer request always stays. */
+static void
+gst_aatv_publish_canvas (GstAATv * aatv, GstAATvCanvas * canvas)
+{
+  GstAATvCanvas *old;
+
+  do {
+    old = g_atomic_pointer_get (&aatv->pending_canvas);
+    if (canvas->serial != g_atomic_int_get (&aatv->canvas_serial) ||
+        (old != NULL && old->serial > canvas->serial)) {
+      gst_aatv_canvas_free (canvas);
+      return;
+    }
+  } while (!g_atomic_pointer_compare_and_exchange (&aatv->pending_canvas, old,
+          canvas));
+
+  if (old != NULL)
+    gst_aatv_canvas_free (old);
+}
+
+/* runs in the canvas thread, aa_init() and loading or building the tables
+ * of a new font take long enough to stall the stream */
+static void
+gst_aatv_build_canvas (GstAATvCanvas * canvas, GstAATv * aatv)
+{
+  /* a newer request is queued behind this one */
+  if (canvas->serial != g_atomic_int_get (&aatv->canvas_serial)) {
+    gst_aatv_canvas_free (canvas);
+    return;
+  }
+
+  if (!gst_aatv_canvas_build (canvas, g_atomic_int_get (&aatv->font))) {
+    GST_WARNING_OBJECT (aatv, "failed to create a %dx%d canvas",
+        canvas->surf.width, canvas->surf.height);
+    gst_aatv_canvas_free (canvas);
+    return;
+  }
+
+  gst_aatv_publish_canvas (aatv, canvas);
+}
+
+/* asks for a context of width x height characters in the negotiated font,
+ * which makes every canvas asked for before stale. The setters call this
+ * under the object lock so the serials follow the order of the settings. */
+static GstAATvCanvas *
+gst_aatv_request_canvas (GstAATv * aatv, gint width, gint height)
+{
+  GstAATvCanvas *canvas = gst_aatv_canvas_new (width, height);
+
+  canvas->serial = g_atomic_int_add (&aatv->canvas_serial, 1) + 1;
+
+  return canvas;
+}
+
+/* builds the requested canvas, the current one keeps rendering until it is
+ * ready. With sync it is built right away, for when there is no stream to
+ * stall and the first frame should already have the right size. Never
+ * called with the object lock held. */
+static void
+gst_aatv_submit_canvas (GstAATv * aatv, GstAATvCanvas * canvas,
+    gboolean sync)
+{
+  if (!sync) {
+    g_thread_pool_push (aatv->canvas_pool, canvas, NULL);
+    return;
+  }
+
+  if (gst_aatv_canvas_build (canvas, g_atomic_int_get (&aatv->font)))
+    gst_aatv_publish_canvas (aatv, canvas);
+  else
+    gst_aatv_canvas_free (canvas);
+}
+
+/* switches to the context built since the last frame, if any */
+static void
+gst_aatv_update_canvas (GstAATv * aatv)
+{
+  GstAATvCanvas *canvas;
+
+  do {
+    canvas = g_atomic_pointer_get (&aatv->pending_canvas);
+  } while (canvas != NULL &&
+      !g_atomic_pointer_compare_and_exchange (&aatv->pending_canvas, canvas,
+          NULL));
 
+  if (canvas == NULL)
+    return;
+
+  /* published just before a newer request, which is on its way */
+  if (canvas->serial != g_atomic_int_get (&aatv->canvas_serial)) {
+    gst_aatv_canvas_free (canvas);
+    return;
+  }
+
+  GST_DEBUG_OBJECT (aatv, "switching to a %dx%d canvas", canvas->surf.width,
+      canvas->surf.height);
+
+  gst_aatv_set_canvas (aatv, canvas);
+
+  /* let the frame time settle on the new size */
+  aatv->frame_time = 0;
+  aatv->budget_settle = GST_AATV_BUDGET_SETTLE;
 }
 
 static guint32
@@ -670,187 +2144,282 @@ gst_aatv_set_color (guint32 input_color, guint8 dim)
 }
 
 static void
-gst_aatv_set_color_rain (GstAATv * aatv, guint input_color)
+gst_aatv_set_color_rain (GstAATvParams * params, guint input_color)
 {
-  aatv->color_rain = input_color;
- aatv->color_rain_bold =  gst_aatv_set_color (input_color, 0);
- aatv->color_rain_normal = gst_aatv_set_color (aatv->color_rain_bold, 1);
-  aatv->color_rain_dim = gst_aatv_set_color (aatv->color_rain_normal, 1);
+  params->color_rain = input_color;
+  params->color_rain_bold = gst_aatv_set_color (input_color, 0);
+  params->color_rain_normal = gst_aatv_set_color (params->color_rain_bold, 1);
+  params->color_rain_dim = gst_aatv_set_color (params->color_rain_normal, 1);
 }
 
 static void
-gst_aatv_set_color_text (GstAATv * aatv, guint input_color)
+gst_aatv_set_color_text (GstAATvParams * params, guint input_color)
 {
-  aatv->color_text = input_color;
-  aatv->color_text_bold = gst_aatv_set_color (input_color, 0);
-  aatv->color_text_normal = gst_aatv_set_color (aatv->color_text_bold, 1);
-  aatv->color_text_dim = gst_aatv_set_color (aatv->color_text_normal, 1);
+  params->color_text = input_color;
+  params->color_text_bold = gst_aatv_set_color (input_color, 0);
+  params->color_text_normal = gst_aatv_set_color (params->color_text_bold, 1);
+  params->color_text_dim = gst_aatv_set_color (params->color_text_normal, 1);
 }
 
 static void
 gst_aatv_init (GstAATv * aatv)
 {
-  aa_defparams.width = 80;
-  aa_defparams.height = 24;
-
-  aatv->ascii_parms.bright = 0;
-  aatv->ascii_parms.contrast = 0;
-  aatv->ascii_parms.gamma = 1.0;
-  aatv->ascii_parms.dither = 0;
-  aatv->ascii_parms.inversion = 0;
-  aatv->ascii_parms.randomval = 0;
-
-  aatv->color_background = gst_aatv_set_color (PROP_AATV_color_background_DEFAULT, 0);
-  gst_aatv_set_color_rain (aatv, PROP_AATV_color_rain_DEFAULT);
-  gst_aatv_set_color_text (aatv, PROP_AATV_color_text_DEFAULT);
-
-  aatv->rain_mode = GST_RAIN_RIGHT;
-
-  gst_aatv_rain_init (aatv);
-
-  aatv->rain_spawn_rate = PROP_RAIN_SPAWN_DEFAULT;
+  GstAATvParams *settings = &aatv->settings;
+  GstAATvCanvas *canvas;
+
+  /* every instance has its own canvas size and font */
+  aatv->width = 80;
+  aatv->height = 24;
+  aatv->font = 0;
+
+  settings->min_width = PROP_MIN_WIDTH_DEFAULT;
+  settings->min_height = PROP_MIN_HEIGHT_DEFAULT;
+  settings->frame_budget = PROP_FRAME_BUDGET_DEFAULT;
+  settings->stats_interval = PROP_STATS_INTERVAL_DEFAULT;
+
+  settings->ascii_parms.bright = 0;
+  settings->ascii_parms.contrast = 0;
+  settings->ascii_parms.gamma = 1.0;
+  settings->ascii_parms.dither = 0;
+  settings->ascii_parms.inversion = 0;
+  settings->ascii_parms.randomval = 0;
+
+  settings->color_background =
+      gst_aatv_set_color (PROP_AATV_color_background_DEFAULT, 0);
+  gst_aatv_set_color_rain (settings, PROP_AATV_color_rain_DEFAULT);
+  gst_aatv_set_color_text (settings, PROP_AATV_color_text_DEFAULT);
+
+  settings->rain_mode = GST_RAIN_RIGHT;
+  settings->seed = PROP_SEED_DEFAULT;
+  settings->rain_spawn_rate = PROP_RAIN_SPAWN_DEFAULT;
+
+  settings->auto_brightness = TRUE;
+  settings->brightness_mode = PROP_BRIGHTNESS_AUTO_MODE_DEFAULT;
+  settings->brightness_target_min = PROP_BRIGHTNESS_TARGET_MIN_DEFAULT;
+  settings->brightness_target_max = PROP_BRIGHTNESS_TARGET_MAX_DEFAULT;
+
+  settings->rain_length_min = PROP_RAIN_LENGTH_MIN_DEFAULT;
+  settings->rain_length_max = PROP_RAIN_LENGTH_MAX_DEFAULT;
+
+  settings->rain_delay_min = PROP_RAIN_DELAY_MIN_DEFAULT;
+  settings->rain_delay_max = PROP_RAIN_DELAY_MAX_DEFAULT;
+
+  settings->n_threads = PROP_N_THREADS_DEFAULT;
+  settings->incremental = PROP_INCREMENTAL_DEFAULT;
+
+  /* the streaming thread starts out with the defaults */
+  aatv->params = *settings;
+  aatv->bright = settings->ascii_parms.bright;
+  gst_aatv_set_lit (aatv, (PROP_BRIGHTNESS_TARGET_MIN_DEFAULT +
+          PROP_BRIGHTNESS_TARGET_MAX_DEFAULT) / 2);
+  /* corrected by the first frames */
+  aatv->exposure_gain = 1.0;
+
+  aatv->render_row = gst_aatv_render_get_row_func (GST_VIDEO_FORMAT_RGBA,
+      NULL);
+  aatv->scaler = gst_aa_scaler_new ();
+  gst_aatv_update_palette (aatv);
+
+  gst_aatv_seed (aatv, settings->seed);
+
+  /* the first canvas is built right away, later ones in the background */
+  canvas = gst_aatv_canvas_new (aatv->width, aatv->height);
+  gst_aatv_canvas_build (canvas, aatv->font);
+  gst_aatv_set_canvas (aatv, canvas);
+  gst_aatv_publish_stats (aatv, gst_aatv_snapshot_stats (aatv));
+  aatv->canvas_pool = g_thread_pool_new ((GFunc) gst_aatv_build_canvas, aatv,
+      1, FALSE, NULL);
+
+  /* skip rendering frames that would arrive late anyway */
+  gst_base_transform_set_qos_enabled (GST_BASE_TRANSFORM (aatv), TRUE);
+}
 
-  aatv->auto_brightness = TRUE;
-  aatv->brightness_target_min = PROP_BRIGHTNESS_TARGET_MIN_DEFAULT;
-  aatv->brightness_target_max = PROP_BRIGHTNESS_TARGET_MAX_DEFAULT;
-  aatv->lit_percentage =
-      (PROP_BRIGHTNESS_TARGET_MIN_DEFAULT +
-      PROP_BRIGHTNESS_TARGET_MAX_DEFAULT) / 2;
+static void
+gst_aatv_finalize (GObject * object)
+{
+  GstAATv *aatv = GST_AATV (object);
 
-  aatv->rain_length_min = PROP_RAIN_LENGTH_MIN_DEFAULT;
-  aatv->rain_length_max = PROP_RAIN_LENGTH_MAX_DEFAULT;
+  /* nothing queued is needed anymore, skip it and wait for the build
+   * that may be running */
+  g_atomic_int_inc (&aatv->canvas_serial);
+  g_thread_pool_free (aatv->canvas_pool, FALSE, TRUE);
+  if (aatv->pending_canvas != NULL)
+    gst_aatv_canvas_free (aatv->pending_canvas);
 
-  aatv->rain_delay_min = PROP_RAIN_DELAY_MIN_DEFAULT;
-  aatv->rain_delay_max = PROP_RAIN_DELAY_MAX_DEFAULT;
+  if (aatv->context != NULL) {
+    gst_aa_tables_detach (aatv->context);
+    aa_close (aatv->context);
+  }
+  free (aatv->raindrops);
+  g_free (aatv->rain_random);
+  g_free (aatv->rain_active);
+  g_free (aatv->rain_mask);
+  gst_aatv_palette_free (&aatv->palette);
+  gst_aa_scaler_free (aatv->scaler);
+  if (aatv->task_runner != NULL)
+    gst_aa_task_runner_free (aatv->task_runner);
+  g_free (aatv->cell_classes);
+  g_free (aatv->cell_dirty);
+  g_free (aatv->scaled_columns);
+  g_free (aatv->scaled_rows);
+  g_free (aatv->scaled_glyph_rows);
+  if (aatv->pending_params != NULL)
+    g_slice_free (GstAATvParams, aatv->pending_params);
+  if (aatv->stats_published != NULL)
+    g_slice_free (GstAATvStatsSnapshot, aatv->stats_published);
+  if (aatv->stats_spare != NULL)
+    g_slice_free (GstAATvStatsSnapshot, aatv->stats_spare);
+
+  G_OBJECT_CLASS (parent_class)->finalize (object);
 }
 
+/* changes the settings for one of the properties that don't need a new
+ * context, called with the object lock held */
 static void
-gst_aatv_set_property (GObject * object, guint prop_id, const GValue * value,
-    GParamSpec * pspec)
+gst_aatv_set_param (GstAATv * aatv, guint prop_id, const GValue * value)
 {
-  GstAATv *aatv = GST_AATV (object);
+  GstAATvParams *settings = &aatv->settings;
 
   switch (prop_id) {
-    case PROP_WIDTH:{
-      aa_defparams.width = g_value_get_int (value);
-      /* recalculate output resolution based on new width */
-      gst_aatv_rain_init (aatv);
-      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
-      break;
-    }
-    case PROP_HEIGHT:{
-      aa_defparams.height = g_value_get_int (value);
-      /* recalculate output resolution based on new height */
-      gst_aatv_rain_init (aatv);
-      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
-      break;
-    }
     case PROP_DITHER:{
-      aatv->ascii_parms.dither = g_value_get_enum (value);
-      break;
-    }
-    case PROP_FONT:{
-      aa_setfont (aatv->context, aa_fonts[g_value_get_enum (value)]);
-      /* recalculate output resolution based on new font */
-      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
+      settings->ascii_parms.dither = g_value_get_enum (value);
       break;
     }
     case PROP_BRIGHTNESS:{
-      aatv->ascii_parms.bright = g_value_get_int (value);
+      settings->ascii_parms.bright = g_value_get_int (value);
+      settings->bright_serial++;
       break;
     }
     case PROP_CONTRAST:{
-      aatv->ascii_parms.contrast = g_value_get_int (value);
+      settings->ascii_parms.contrast = g_value_get_int (value);
       break;
     }
     case PROP_GAMMA:{
-      aatv->ascii_parms.gamma = g_value_get_float (value);
+      settings->ascii_parms.gamma = g_value_get_float (value);
       break;
     }
     case PROP_BRIGHTNESS_TARGET_MIN:{
-      if (g_value_get_float (value) <= aatv->brightness_target_max)
-        aatv->brightness_target_min = g_value_get_float (value);
+      if (g_value_get_float (value) <= settings->brightness_target_max)
+        settings->brightness_target_min = g_value_get_float (value);
       break;
     }
     case PROP_BRIGHTNESS_TARGET_MAX:{
-      if (g_value_get_float (value) >= aatv->brightness_target_min)
-        aatv->brightness_target_max = g_value_get_float (value);
+      if (g_value_get_float (value) >= settings->brightness_target_min)
+        settings->brightness_target_max = g_value_get_float (value);
       break;
     }
     case PROP_RAIN_SPAWN_RATE:{
-      aatv->rain_spawn_rate = g_value_get_float (value);
+      settings->rain_spawn_rate = g_value_get_float (value);
       break;
     }
     case PROP_COLOR_TEXT:{
-      aatv->color_text = g_value_get_uint (value);
-      gst_aatv_set_color_text (aatv, aatv->color_text);
+      settings->color_text = g_value_get_uint (value);
+      gst_aatv_set_color_text (settings, settings->color_text);
       break;
     }
     case PROP_COLOR_TEXT_BOLD:{
-    aatv->color_text_bold = gst_aatv_set_color (g_value_get_uint (value), 0);
+      settings->color_text_bold =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_TEXT_NORMAL:{
-      aatv->color_text_normal =gst_aatv_set_color ( g_value_get_uint (value),
-          0);
+      settings->color_text_normal =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_TEXT_DIM:{
-      aatv->color_text_dim = gst_aatv_set_color ( g_value_get_uint (value), 0);
+      settings->color_text_dim =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_BACKGROUND:{
-      aatv->color_background =gst_aatv_set_color (g_value_get_uint (value), 0);
+      settings->color_background =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_RAIN:{
-      aatv->color_rain = g_value_get_uint (value);
-      gst_aatv_set_color_rain (aatv, aatv->color_rain);
+      settings->color_rain = g_value_get_uint (value);
+      gst_aatv_set_color_rain (settings, settings->color_rain);
       break;
     }
     case PROP_COLOR_RAIN_BOLD:{
-     aatv->color_rain_bold = gst_aatv_set_color ( g_value_get_uint (value), 0);
+      settings->color_rain_bold =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_RAIN_NORMAL:{
-     aatv->color_rain_normal = gst_aatv_set_color ( g_value_get_uint (value),
-          0);
+      settings->color_rain_normal =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_COLOR_RAIN_DIM:{
-   aatv->color_rain_dim = gst_aatv_set_color ( g_value_get_uint (value), 0);
+      settings->color_rain_dim =
+          gst_aatv_set_color (g_value_get_uint (value), 0);
       break;
     }
     case PROP_BRIGHTNESS_AUTO:{
-      aatv->auto_brightness = g_value_get_boolean (value);
+      settings->auto_brightness = g_value_get_boolean (value);
+      break;
+    }
+    case PROP_BRIGHTNESS_AUTO_MODE:{
+      settings->brightness_mode = g_value_get_enum (value);
       break;
     }
     case PROP_RANDOMVAL:{
-      aatv->ascii_parms.randomval = g_value_get_int (value);
+      settings->ascii_parms.randomval = g_value_get_int (value);
       break;
     }
     case PROP_RAIN_DELAY_MIN:{
-      if (g_value_get_float (value) <= aatv->rain_delay_max)
-        aatv->rain_delay_min = g_value_get_int (value);
+      if (g_value_get_float (value) <= settings->rain_delay_max)
+        settings->rain_delay_min = g_value_get_int (value);
       break;
     }
     case PROP_RAIN_DELAY_MAX:{
-      if (g_value_get_float (value) >= aatv->rain_delay_min)
-        aatv->rain_delay_max = g_value_get_int (value);
+      if (g_value_get_float (value) >= settings->rain_delay_min)
+        settings->rain_delay_max = g_value_get_int (value);
       break;
     }
     case PROP_RAIN_LENGTH_MIN:{
-      if (g_value_get_float (value) <= aatv->rain_length_max)
-        aatv->rain_length_min = g_value_get_int (value);
+      if (g_value_get_float (value) <= settings->rain_length_max)
+        settings->rain_length_min = g_value_get_int (value);
       break;
     }
     case PROP_RAIN_LENGTH_MAX:{
-      if (g_value_get_float (value) >= aatv->rain_length_min)
-        aatv->rain_length_max = g_value_get_int (value);
+      if (g_value_get_float (value) >= settings->rain_length_min)
+        settings->rain_length_max = g_value_get_int (value);
       break;
     }
     case PROP_RAIN_MODE:{
-      aatv->rain_mode = g_value_get_enum (value);
+      settings->rain_mode = g_value_get_enum (value);
+      break;
+    }
+    case PROP_N_THREADS:{
+      settings->n_threads = g_value_get_uint (value);
+      break;
+    }
+    case PROP_INCREMENTAL:{
+      settings->incremental = g_value_get_boolean (value);
+      break;
+    }
+    case PROP_FRAME_BUDGET:{
+      settings->frame_budget = g_value_get_uint64 (value);
+      break;
+    }
+    case PROP_MIN_WIDTH:{
+      settings->min_width = g_value_get_int (value);
+      break;
+    }
+    case PROP_MIN_HEIGHT:{
+      settings->min_height = g_value_get_int (value);
+      break;
+    }
+    case PROP_STATS_INTERVAL:{
+      settings->stats_interval = g_value_get_uint64 (value);
+      break;
+    }
+    case PROP_SEED:{
+      settings->seed = g_value_get_uint (value);
+      settings->seed_serial++;
       break;
     }
     default:
@@ -858,120 +2427,229 @@ gst_aatv_set_property (GObject * object, guint prop_id, const GValue * value,
   }
 }
 
+static void
+gst_aatv_set_property (GObject * object, guint prop_id, const GValue * value,
+    GParamSpec * pspec)
+{
+  GstAATv *aatv = GST_AATV (object);
+  GstAATvCanvas *canvas;
+  gboolean sync;
+
+  switch (prop_id) {
+    case PROP_WIDTH:{
+      GST_OBJECT_LOCK (aatv);
+      g_atomic_int_set (&aatv->width, g_value_get_int (value));
+      canvas = gst_aatv_request_canvas (aatv, aatv->width, aatv->height);
+      sync = GST_STATE (aatv) <= GST_STATE_READY;
+      GST_OBJECT_UNLOCK (aatv);
+      gst_aatv_submit_canvas (aatv, canvas, sync);
+      /* recalculate output resolution based on new width */
+      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
+      break;
+    }
+    case PROP_HEIGHT:{
+      GST_OBJECT_LOCK (aatv);
+      g_atomic_int_set (&aatv->height, g_value_get_int (value));
+      canvas = gst_aatv_request_canvas (aatv, aatv->width, aatv->height);
+      sync = GST_STATE (aatv) <= GST_STATE_READY;
+      GST_OBJECT_UNLOCK (aatv);
+      gst_aatv_submit_canvas (aatv, canvas, sync);
+      /* recalculate output resolution based on new height */
+      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
+      break;
+    }
+    case PROP_FONT:{
+      GST_OBJECT_LOCK (aatv);
+      g_atomic_int_set (&aatv->font, g_value_get_enum (value));
+      canvas = gst_aatv_request_canvas (aatv, aatv->width, aatv->height);
+      sync = GST_STATE (aatv) <= GST_STATE_READY;
+      GST_OBJECT_UNLOCK (aatv);
+      gst_aatv_submit_canvas (aatv, canvas, sync);
+      /* recalculate output resolution based on new font */
+      gst_pad_mark_reconfigure (GST_BASE_TRANSFORM_SRC_PAD (object));
+      break;
+    }
+    default:{
+      /* the streaming thread picks these up with the next frame */
+      GST_OBJECT_LOCK (aatv);
+      gst_aatv_set_param (aatv, prop_id, value);
+      gst_aatv_publish_params (aatv);
+      GST_OBJECT_UNLOCK (aatv);
+      break;
+    }
+  }
+
+}
+
 static void
 gst_aatv_get_property (GObject * object, guint prop_id, GValue * value,
     GParamSpec * pspec)
 {
   GstAATv *aatv = GST_AATV (object);
 
+  GST_OBJECT_LOCK (aatv);
   switch (prop_id) {
     case PROP_BRIGHTNESS_ACTUAL:{
-      g_value_set_float (value, aatv->lit_percentage);
+      gint bits = g_atomic_int_get (&aatv->lit_published);
+      gfloat lit;
+
+      memcpy (&lit, &bits, sizeof (lit));
+      g_value_set_float (value, lit);
       break;
     }
     case PROP_WIDTH:{
-      g_value_set_int (value, aa_defparams.width);
+      g_value_set_int (value, aatv->width);
       break;
     }
     case PROP_HEIGHT:{
-      g_value_set_int (value, aa_defparams.height);
+      g_value_set_int (value, aatv->height);
 
       break;
     }
     case PROP_DITHER:{
-      g_value_set_enum (value, aatv->ascii_parms.dither);
+      g_value_set_enum (value, aatv->settings.ascii_parms.dither);
       break;
     }
     case PROP_FONT:{
-      g_value_set_enum (value, aatv->ascii_parms.dither);
+      g_value_set_enum (value, aatv->font);
       break;
     }
     case PROP_BRIGHTNESS:{
-      g_value_set_int (value, aatv->ascii_parms.bright);
+      /* the streaming thread only owns the brightness while it moves it */
+      if (aatv->settings.auto_brightness)
+        g_value_set_int (value, g_atomic_int_get (&aatv->bright));
+      else
+        g_value_set_int (value, aatv->settings.ascii_parms.bright);
       break;
     }
     case PROP_BRIGHTNESS_AUTO:{
-      g_value_set_boolean (value, aatv->auto_brightness);
+      g_value_set_boolean (value, aatv->settings.auto_brightness);
+      break;
+    }
+    case PROP_BRIGHTNESS_AUTO_MODE:{
+      g_value_set_enum (value, aatv->settings.brightness_mode);
       break;
     }
     case PROP_CONTRAST:{
-      g_value_set_int (value, aatv->ascii_parms.contrast);
+      g_value_set_int (value, aatv->settings.ascii_parms.contrast);
       break;
     }
     case PROP_GAMMA:{
-      g_value_set_float (value, aatv->ascii_parms.gamma);
+      g_value_set_float (value, aatv->settings.ascii_parms.gamma);
       break;
     }
     case PROP_RAIN_SPAWN_RATE:{
-      g_value_set_float (value, aatv->rain_spawn_rate);
+      g_value_set_float (value, aatv->settings.rain_spawn_rate);
       break;
     }
     case PROP_BRIGHTNESS_TARGET_MIN:{
-      g_value_set_float (value, aatv->brightness_target_min);
+      g_value_set_float (value, aatv->settings.brightness_target_min);
       break;
     }
     case PROP_BRIGHTNESS_TARGET_MAX:{
-      g_value_set_float (value, aatv->brightness_target_max);
+      g_value_set_float (value, aatv->settings.brightness_target_max);
       break;
     }
     case PROP_COLOR_TEXT:{
-      g_value_set_uint (value, aatv->color_text);
+      g_value_set_uint (value, aatv->settings.color_text);
       break;
     }
     case PROP_COLOR_TEXT_BOLD:{
-      g_value_set_uint (value, aatv->color_text_bold);
+      g_value_set_uint (value, aatv->settings.color_text_bold);
       break;
     }
     case PROP_COLOR_TEXT_NORMAL:{
-      g_value_set_uint (value, aatv->color_text_normal);
+      g_value_set_uint (value, aatv->settings.color_text_normal);
       break;
     }
     case PROP_COLOR_TEXT_DIM:{
-      g_value_set_uint (value, aatv->color_text_dim);
+      g_value_set_uint (value, aatv->settings.color_text_dim);
       break;
     }
     case PROP_COLOR_BACKGROUND:{
-      g_value_set_uint (value, aatv->color_background);
+      g_value_set_uint (value, aatv->settings.color_background);
       break;
     }
     case PROP_COLOR_RAIN:{
-      g_value_set_uint (value, aatv->color_rain);
+      g_value_set_uint (value, aatv->settings.color_rain);
       break;
     }
     case PROP_COLOR_RAIN_BOLD:{
-      g_value_set_uint (value, aatv->color_rain_bold);
+      g_value_set_uint (value, aatv->settings.color_rain_bold);
       break;
     }
     case PROP_COLOR_RAIN_NORMAL:{
-      g_value_set_uint (value, aatv->color_rain_normal);
+      g_value_set_uint (value, aatv->settings.color_rain_normal);
       break;
     }
     case PROP_COLOR_RAIN_DIM:{
-      g_value_set_uint (value, aatv->color_rain_dim);
+      g_value_set_uint (value, aatv->settings.color_rain_dim);
       break;
     }
     case PROP_RANDOMVAL:{
-      g_value_set_int (value, aatv->ascii_parms.randomval);
+      g_value_set_int (value, aatv->settings.ascii_parms.randomval);
       break;
     }
     case PROP_RAIN_MODE:{
-      g_value_set_enum (value, aatv->rain_mode);
+      g_value_set_enum (value, aatv->settings.rain_mode);
       break;
     }
     case PROP_RAIN_DELAY_MIN:{
-      g_value_set_int (value, aatv->rain_delay_min);
+      g_value_set_int (value, aatv->settings.rain_delay_min);
       break;
     }
     case PROP_RAIN_DELAY_MAX:{
-      g_value_set_int (value, aatv->rain_delay_max);
+      g_value_set_int (value, aatv->settings.rain_delay_max);
       break;
     }
     case PROP_RAIN_LENGTH_MIN:{
-      g_value_set_int (value, aatv->rain_length_min);
+      g_value_set_int (value, aatv->settings.rain_length_min);
       break;
     }
     case PROP_RAIN_LENGTH_MAX:{
-      g_value_set_int (value, aatv->rain_length_max);
+      g_value_set_int (value, aatv->settings.rain_length_max);
+      break;
+    }
+    case PROP_N_THREADS:{
+      g_value_set_uint (value, aatv->settings.n_threads);
+      break;
+    }
+    case PROP_INCREMENTAL:{
+      g_value_set_boolean (value, aatv->settings.incremental);
+      break;
+    }
+    case PROP_FRAMES_DROPPED:{
+      guint64 frames_dropped = 0;
+
+      gst_aatv_read_stats (aatv, NULL, &frames_dropped);
+      g_value_set_uint64 (value, frames_dropped);
+      break;
+    }
+    case PROP_FRAME_BUDGET:{
+      g_value_set_uint64 (value, aatv->settings.frame_budget);
+      break;
+    }
+    case PROP_MIN_WIDTH:{
+      g_value_set_int (value, aatv->settings.min_width);
+      break;
+    }
+    case PROP_MIN_HEIGHT:{
+      g_value_set_int (value, aatv->settings.min_height);
+      break;
+    }
+    case PROP_STATS:{
+      GstStructure *stats = NULL;
+
+      gst_aatv_read_stats (aatv, &stats, NULL);
+      g_value_take_boxed (value, stats);
+      break;
+    }
+    case PROP_STATS_INTERVAL:{
+      g_value_set_uint64 (value, aatv->settings.stats_interval);
+      break;
+    }
+    case PROP_SEED:{
+      g_value_set_uint (value, aatv->settings.seed);
       break;
     }
     default:{
@@ -979,4 +2657,5 @@ gst_aatv_get_property (GObject * object, guint prop_id, GValue * value,
       break;
     }
   }
+  GST_OBJECT_UNLOCK (aatv);
 }
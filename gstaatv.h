@@ -26,6 +26,13 @@
 #include <gst/video/video.h>
 #include <aalib.h>
 
+#include "gstaascale.h"
+#include "gstaastats.h"
+#include "gstaatables.h"
+#include "gstaatask.h"
+#include "gstaatvmeta.h"
+#include "gstaatvrender.h"
+
 
 #ifdef __cplusplus
 extern "C" {
@@ -46,6 +53,9 @@ extern "C" {
 	typedef struct _GstAATv GstAATv;
 	typedef struct _GstAATvClass GstAATvClass;
 	typedef struct _GstAATvDroplet GstAATvDroplet;
+	typedef struct _GstAATvParams GstAATvParams;
+	typedef struct _GstAATvCanvas GstAATvCanvas;
+	typedef struct _GstAATvStatsSnapshot GstAATvStatsSnapshot;
 	typedef struct _GstAATvARGB GstAATvARGB;
 
 	typedef enum {
@@ -56,6 +66,22 @@ extern "C" {
 		GST_RAIN_RIGHT
 	} GstRainMode;
 
+	/* how brightness-auto moves the brightness */
+	typedef enum {
+		GST_AATV_BRIGHTNESS_STEP,
+		GST_AATV_BRIGHTNESS_HISTOGRAM
+	} GstAATvBrightnessMode;
+
+	/* timed steps of a frame, see the stats property */
+	typedef enum {
+		GST_AATV_STAGE_RAIN,
+		GST_AATV_STAGE_SCALE,
+		GST_AATV_STAGE_MATCH,
+		GST_AATV_STAGE_RENDER,
+		GST_AATV_STAGE_FRAME,
+		GST_AATV_N_STAGES
+	} GstAATvStage;
+
 	struct _GstAATvDroplet {
 		gboolean enabled;
 		gint location;		
@@ -63,40 +89,169 @@ extern "C" {
 		gint delay;
 		gint delay_counter;
 	};
-	
-
-	
-	struct _GstAATv {
-		GstVideoFilter videofilter;
-
-		aa_context *context;
 
+	/* everything properties change about a frame that doesn't need a new
+	 * context, copied as a whole between threads */
+	struct _GstAATvParams {
 		guint32 color_text;
 		guint32 color_text_bold,color_text_normal,color_text_dim;
 		guint32 color_rain;
 		guint32 color_rain_bold,color_rain_normal,color_rain_dim;
 		guint32 color_background;
-		
-		GstRainMode rain_mode;
 
-		gint rain_width;
-		gint rain_height;
-		
+		struct aa_renderparams ascii_parms;
+		/* bumped by the brightness property, auto-brightness starts over
+		 * from the new value */
+		guint bright_serial;
+		gboolean auto_brightness;
+		GstAATvBrightnessMode brightness_mode;
+		gfloat brightness_target_min;
+		gfloat brightness_target_max;
+
+		GstRainMode rain_mode;
 		gint rain_length_min;
 		gint rain_length_max;
-
 		gint rain_delay_min;
 		gint rain_delay_max;
-		
 		gfloat rain_spawn_rate;
+		/* bumped by the seed property to restart the generator */
+		guint seed;
+		guint seed_serial;
+
+		guint n_threads;
+		/* only redraw changed cells into recycled output memory */
+		gboolean incremental;
+		/* processing time allowed per frame */
+		GstClockTime frame_budget;
+		gint min_width, min_height;
+		/* element message interval */
+		GstClockTime stats_interval;
+	};
+
+	/* an aalib context for one canvas size and font, built away from the
+	 * streaming thread and switched to between frames */
+	struct _GstAATvCanvas {
+		struct aa_hardware_params surf;
+		gint font;
+		aa_context *context;
+		/* request it was built for, see canvas_serial */
+		gint serial;
+	};
+
+	/* what the stats and frames-dropped properties report, copied out by
+	 * the streaming thread after every frame */
+	struct _GstAATvStatsSnapshot {
+		GstAAStats stats[GST_AATV_N_STAGES];
+		guint64 frames_dropped;
+		gint columns, rows;
+	};
+	
+
+	
+	struct _GstAATv {
+		GstVideoFilter videofilter;
+
+		aa_context *context;
+
+		/* properties as set, under the object lock */
+		GstAATvParams settings;
+		/* the last copy of settings published for the streaming thread */
+		GstAATvParams * pending_params;
+		/* what the streaming thread renders with, picked up from
+		 * pending_params when a frame starts */
+		GstAATvParams params;
+
+		/* builds the contexts width, height, font and the frame budget
+		 * ask for, one at a time */
+		GThreadPool * canvas_pool;
+		/* bumped with every request, older ones are skipped */
+		gint canvas_serial;
+		/* the last context built, picked up when a frame starts */
+		GstAATvCanvas * pending_canvas;
+
+		gint rain_width;
+		gint rain_height;
 		
-		gboolean auto_brightness;
-		gfloat brightness_target_min;
-		gfloat brightness_target_max;
+		/* rain's random numbers, one draw per column and frame */
+		guint64 random_state;
+		guint32 * rain_random;
+		
+		/* brightness as auto-brightness moved it, only written by the
+		 * streaming thread and published atomically for the property */
+		gint bright;
 		gfloat lit_percentage;
+		/* the bits of lit_percentage, published the same way */
+		gint lit_published;
+		/* histogram mode: the level the current frame was exposed for and
+		 * the lit fraction that level turned out to give, per unit */
+		gfloat exposure_level;
+		gfloat exposure_gain;
 		
 		GstAATvDroplet * raindrops;
-		struct aa_renderparams ascii_parms;
+		/* droplets that are falling, by index into raindrops */
+		guint * rain_active;
+		guint rain_n_active;
+		/* per cell, GST_AATV_CLASS_RAIN_NORMAL where a droplet is */
+		guint8 * rain_mask;
+		/* canvas size and font the output is negotiated for, set under
+		 * the object lock and read atomically by the streaming thread */
+		gint width, height;
+		gint font;
+		/* the canvas the context was built for, which lags behind the
+		 * above until it is rebuilt and which the frame budget can make
+		 * smaller. ascii_font indexes aa_fonts. */
+		struct aa_hardware_params ascii_surf;
+		gint ascii_font;
+
+		GstAATvPalette palette;
+		GstAATvRowFunc render_row;
+
+		GstAATaskRunner * task_runner;
+		GstAAScaler * scaler;
+		/* lit pixels of every character in the current font */
+		guint16 glyph_lit[256];
+		/* color class of every cell in the current frame */
+		guint8 * cell_classes;
+		/* cells that differ from what the output memory already shows */
+		guint8 * cell_dirty;
+		/* the canvas pixel column under every output column of a
+		 * stretched canvas, and the first cell and glyph row under every
+		 * output row, for the sizes below */
+		guint * scaled_columns;
+		guint * scaled_rows;
+		guint * scaled_glyph_rows;
+		guint scaled_out_width, scaled_out_height;
+		guint scaled_width, scaled_height, scaled_font_height;
+
+		/* bumped whenever every cell of recycled output memory is stale */
+		gint epoch;
+
+		/* negotiated application/x-aatv-cells instead of raw video, and
+		 * the grid size of those caps */
+		gboolean cells_output;
+		gint cells_width, cells_height;
+
+		/* a frame went through before_transform but not transform yet,
+		 * owned by the streaming thread */
+		gboolean frame_pending;
+		guint64 frames_dropped;
+
+		/* smoothed processing time per frame, see frame-budget */
+		GstClockTime frame_time;
+		guint budget_settle;
+
+		/* when the current frame entered before_transform and the time each
+		 * of its stages took. These, stats and frames_dropped are owned by
+		 * the streaming thread, the getters only ever see stats_published. */
+		GstClockTime frame_start;
+		GstClockTime stage_times[GST_AATV_N_STAGES];
+		GstAAStats stats[GST_AATV_N_STAGES];
+		/* the last snapshot of the stats, and the one the next gets
+		 * written into */
+		GstAATvStatsSnapshot * stats_published;
+		GstAATvStatsSnapshot * stats_spare;
+		/* when the last stats message went out */
+		GstClockTime stats_posted;
 	};
 
 	struct _GstAATvClass {
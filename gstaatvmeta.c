@@ -0,0 +1,129 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Character cell grid attached to aatv output, so downstream can get at
+ * the text of a frame without reading it back from the pixels. The three
+ * planes share one allocation in the same layout as the cells caps. */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string.h>
+
+#include "gstaatvmeta.h"
+
+GType
+gst_aatv_cells_meta_api_get_type (void)
+{
+  static GType type;
+  static const gchar *tags[] = { NULL };
+
+  if (g_once_init_enter (&type)) {
+    GType _type = gst_meta_api_type_register ("GstAATvCellsMetaAPI", tags);
+    g_once_init_leave (&type, _type);
+  }
+  return type;
+}
+
+static gboolean
+gst_aatv_cells_meta_init (GstMeta * meta, gpointer params, GstBuffer * buffer)
+{
+  GstAATvCellsMeta *cells = (GstAATvCellsMeta *) meta;
+
+  cells->width = 0;
+  cells->height = 0;
+  cells->font = 0;
+  cells->text = cells->attrs = cells->flags = NULL;
+
+  return TRUE;
+}
+
+static void
+gst_aatv_cells_meta_free (GstMeta * meta, GstBuffer * buffer)
+{
+  GstAATvCellsMeta *cells = (GstAATvCellsMeta *) meta;
+
+  g_free (cells->text);
+}
+
+static void
+gst_aatv_cells_meta_alloc (GstAATvCellsMeta * cells, guint width,
+    guint height, gint font)
+{
+  gsize n_cells = (gsize) width * height;
+
+  cells->width = width;
+  cells->height = height;
+  cells->font = font;
+  cells->text = g_malloc (3 * n_cells);
+  cells->attrs = cells->text + n_cells;
+  cells->flags = cells->attrs + n_cells;
+}
+
+static gboolean
+gst_aatv_cells_meta_transform (GstBuffer * dest, GstMeta * meta,
+    GstBuffer * buffer, GQuark type, gpointer data)
+{
+  GstAATvCellsMeta *smeta = (GstAATvCellsMeta *) meta;
+  GstAATvCellsMeta *dmeta;
+
+  /* the grid doesn't depend on the size or format of the pixels, so every
+   * transform keeps it */
+  dmeta = gst_buffer_add_aatv_cells_meta (dest, smeta->width, smeta->height,
+      smeta->font);
+  if (!dmeta)
+    return FALSE;
+
+  memcpy (dmeta->text, smeta->text, 3 * (gsize) smeta->width * smeta->height);
+
+  return TRUE;
+}
+
+const GstMetaInfo *
+gst_aatv_cells_meta_get_info (void)
+{
+  static const GstMetaInfo *meta_info = NULL;
+
+  if (g_once_init_enter ((GstMetaInfo **) & meta_info)) {
+    const GstMetaInfo *mi =
+        gst_meta_register (GST_AATV_CELLS_META_API_TYPE, "GstAATvCellsMeta",
+        sizeof (GstAATvCellsMeta), gst_aatv_cells_meta_init,
+        gst_aatv_cells_meta_free, gst_aatv_cells_meta_transform);
+    g_once_init_leave ((GstMetaInfo **) & meta_info, (GstMetaInfo *) mi);
+  }
+  return meta_info;
+}
+
+/* adds an uninitialized grid of width x height cells to buffer */
+GstAATvCellsMeta *
+gst_buffer_add_aatv_cells_meta (GstBuffer * buffer, guint width,
+    guint height, gint font)
+{
+  GstAATvCellsMeta *cells;
+
+  g_return_val_if_fail (GST_IS_BUFFER (buffer), NULL);
+
+  cells = (GstAATvCellsMeta *) gst_buffer_add_meta (buffer,
+      GST_AATV_CELLS_META_INFO, NULL);
+  if (cells)
+    gst_aatv_cells_meta_alloc (cells, width, height, font);
+
+  return cells;
+}
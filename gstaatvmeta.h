@@ -0,0 +1,76 @@
+/* GStreamer
+ * Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+
+#ifndef __GST_AATV_META_H__
+#define __GST_AATV_META_H__
+
+#include <gst/gst.h>
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/* media type of the character cell output of aatv, a buffer holds three
+ * planes of width x height bytes (width and height in cells): the
+ * characters, their aalib attributes and GstAATvCellFlags */
+#define GST_AATV_CELLS_MEDIA_TYPE "application/x-aatv-cells"
+#define GST_AATV_CELLS_CAPS GST_AATV_CELLS_MEDIA_TYPE ", " \
+    "width = (int) [ 1, MAX ], height = (int) [ 1, MAX ], " \
+    "font = (int) [ 0, MAX ], framerate = (fraction) [ 0, MAX ]"
+
+#define GST_AATV_CELLS_META_API_TYPE (gst_aatv_cells_meta_api_get_type())
+#define GST_AATV_CELLS_META_INFO (gst_aatv_cells_meta_get_info())
+
+#define gst_buffer_get_aatv_cells_meta(b) \
+		((GstAATvCellsMeta*)gst_buffer_get_meta((b),GST_AATV_CELLS_META_API_TYPE))
+
+	typedef struct _GstAATvCellsMeta GstAATvCellsMeta;
+
+	typedef enum {
+		GST_AATV_CELL_RAIN = (1 << 0)
+	} GstAATvCellFlags;
+
+	/* the character grid a frame was drawn from, font is the index into
+	 * aa_fonts */
+	struct _GstAATvCellsMeta {
+		GstMeta meta;
+
+		guint width;
+		guint height;
+		gint font;
+
+		guint8 *text;
+		guint8 *attrs;
+		guint8 *flags;
+	};
+
+	GType gst_aatv_cells_meta_api_get_type (void);
+	const GstMetaInfo *gst_aatv_cells_meta_get_info (void);
+
+	GstAATvCellsMeta *gst_buffer_add_aatv_cells_meta (GstBuffer * buffer,
+			guint width, guint height, gint font);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AATV_META_H__ */
@@ -0,0 +1,453 @@
+/* GStreamer
+* Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Library General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Library General Public License for more details.
+*
+* You should have received a copy of the GNU Library General Public
+* License along with this library; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+* Boston, MA 02110-1301, USA.
+*/
+
+/* Glyph row expansion kernels for aatv.
+ *
+ * Every kernel turns a row of glyph bytes into 8 pixels per cell. The
+ * scalar kernels copy ready made spans out of the palette, the vector
+ * kernels build a per-pixel mask from the glyph bits and blend foreground
+ * and background with it. The best RGBA kernel the CPU supports is picked
+ * once at runtime, GST_AATV_KERNEL=scalar|sse2|avx2|neon forces a specific
+ * one so all of them can be compared on the same machine. The smaller
+ * formats only have span copies, one 8 or 16 byte copy per cell.
+ *
+ * For I420 and NV12 the spans hold the luma, the chroma planes are filled
+ * separately from pairs of glyph rows.
+ */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "gstaatvrender.h"
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define GST_AATV_HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GST_AATV_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+#define CHECK_BIT(var,pos) ((var) & (1<<(pos)))
+
+/* BT.601, full range for GRAY8 and studio range for YUV */
+#define GST_AATV_R(c) ((c) & 0xff)
+#define GST_AATV_G(c) (((c) >> 8) & 0xff)
+#define GST_AATV_B(c) (((c) >> 16) & 0xff)
+#define GST_AATV_GRAY(c) ((77 * GST_AATV_R (c) + 150 * GST_AATV_G (c) + \
+        29 * GST_AATV_B (c) + 128) >> 8)
+#define GST_AATV_Y(c) (((66 * GST_AATV_R (c) + 129 * GST_AATV_G (c) + \
+        25 * GST_AATV_B (c) + 128) >> 8) + 16)
+#define GST_AATV_U(c) (((-38 * GST_AATV_R (c) - 74 * GST_AATV_G (c) + \
+        112 * GST_AATV_B (c) + 128) >> 8) + 128)
+#define GST_AATV_V(c) (((112 * GST_AATV_R (c) - 94 * GST_AATV_G (c) - \
+        18 * GST_AATV_B (c) + 128) >> 8) + 128)
+
+/* writes color in the layout of the first plane of format */
+static void
+gst_aatv_palette_pixel (GstVideoFormat format, guint32 color, guint8 * dest)
+{
+  guint16 rgb16;
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_GRAY8:
+      dest[0] = GST_AATV_GRAY (color);
+      break;
+    case GST_VIDEO_FORMAT_RGB16:
+      rgb16 = ((GST_AATV_R (color) >> 3) << 11) |
+          ((GST_AATV_G (color) >> 2) << 5) | (GST_AATV_B (color) >> 3);
+      memcpy (dest, &rgb16, sizeof (rgb16));
+      break;
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:
+      dest[0] = GST_AATV_Y (color);
+      break;
+    default:
+      memcpy (dest, &color, sizeof (color));
+      break;
+  }
+}
+
+gboolean
+gst_aatv_palette_has_chroma (const GstAATvPalette * palette)
+{
+  return palette->format == GST_VIDEO_FORMAT_I420 ||
+      palette->format == GST_VIDEO_FORMAT_NV12;
+}
+
+void
+gst_aatv_palette_update (GstAATvPalette * palette)
+{
+  guint color_class, glyph, font_x, bits;
+  guint8 fg[4], bg[4];
+  guint pstride;
+  guint8 *span;
+
+  switch (palette->format) {
+    case GST_VIDEO_FORMAT_GRAY8:
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:
+      pstride = 1;
+      break;
+    case GST_VIDEO_FORMAT_RGB16:
+      pstride = 2;
+      break;
+    default:
+      palette->format = GST_VIDEO_FORMAT_RGBA;
+      pstride = 4;
+      break;
+  }
+
+  if (palette->spans == NULL || palette->pstride != pstride)
+    palette->spans = g_renew (guint8, palette->spans,
+        GST_AATV_N_CLASSES * 256 * 8 * pstride);
+  palette->pstride = pstride;
+
+  gst_aatv_palette_pixel (palette->format, palette->background, bg);
+
+  span = palette->spans;
+  for (color_class = 0; color_class < GST_AATV_N_CLASSES; color_class++) {
+    guint32 color = palette->colors[color_class];
+
+    gst_aatv_palette_pixel (palette->format, color, fg);
+
+    for (glyph = 0; glyph < 256; glyph++) {
+      /* font glyphs are always 8 pixels wide, bit 0 is the leftmost pixel */
+      for (font_x = 0; font_x < 8; font_x++) {
+        if (CHECK_BIT (glyph, font_x))
+          memcpy (span, fg, pstride);
+        else
+          memcpy (span, bg, pstride);
+        span += pstride;
+      }
+    }
+
+    for (bits = 0; bits < 4; bits++) {
+      guint32 left = CHECK_BIT (bits, 0) ? color : palette->background;
+      guint32 right = CHECK_BIT (bits, 1) ? color : palette->background;
+
+      palette->chroma_u[color_class][bits] =
+          GST_AATV_U (left) + GST_AATV_U (right);
+      palette->chroma_v[color_class][bits] =
+          GST_AATV_V (left) + GST_AATV_V (right);
+    }
+  }
+}
+
+void
+gst_aatv_palette_free (GstAATvPalette * palette)
+{
+  g_free (palette->spans);
+  palette->spans = NULL;
+}
+
+static void
+gst_aatv_render_row_scalar (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  guint x;
+
+  for (x = 0; x < n_cells; x++) {
+    memcpy (dest, palette->spans + (classes[x] * 256 + glyphs[x]) * 8 * 4,
+        8 * 4);
+    dest += 8 * 4;
+  }
+}
+
+static void
+gst_aatv_render_row_span8 (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  guint x;
+
+  for (x = 0; x < n_cells; x++) {
+    memcpy (dest, palette->spans + (classes[x] * 256 + glyphs[x]) * 8, 8);
+    dest += 8;
+  }
+}
+
+static void
+gst_aatv_render_row_span16 (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  guint x;
+
+  for (x = 0; x < n_cells; x++) {
+    memcpy (dest, palette->spans + (classes[x] * 256 + glyphs[x]) * 8 * 2,
+        8 * 2);
+    dest += 8 * 2;
+  }
+}
+
+/* fills the 4 chroma samples under every cell of a pair of pixel rows, each
+ * sample averages the 2x2 pixels it covers. glyphs0/classes0 belong to the
+ * upper row, glyphs1/classes1 to the lower one, which can be in the next
+ * character row. pstride is 1 for separate U and V planes and 2 for
+ * interleaved ones. */
+void
+gst_aatv_render_chroma_row (guint8 * u, guint8 * v, guint pstride,
+    const guint8 * glyphs0, const guint8 * classes0,
+    const guint8 * glyphs1, const guint8 * classes1, guint n_cells,
+    const GstAATvPalette * palette)
+{
+  guint x, k;
+
+  for (x = 0; x < n_cells; x++) {
+    const guint16 *u0 = palette->chroma_u[classes0[x]];
+    const guint16 *u1 = palette->chroma_u[classes1[x]];
+    const guint16 *v0 = palette->chroma_v[classes0[x]];
+    const guint16 *v1 = palette->chroma_v[classes1[x]];
+
+    for (k = 0; k < 4; k++) {
+      guint bits0 = (glyphs0[x] >> (2 * k)) & 3;
+      guint bits1 = (glyphs1[x] >> (2 * k)) & 3;
+
+      *u = (u0[bits0] + u1[bits1] + 2) >> 2;
+      *v = (v0[bits0] + v1[bits1] + 2) >> 2;
+      u += pstride;
+      v += pstride;
+    }
+  }
+}
+
+#ifdef GST_AATV_HAVE_X86
+__attribute__ ((target ("sse2")))
+static void
+gst_aatv_render_row_sse2 (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  const __m128i bits_lo = _mm_setr_epi32 (1, 2, 4, 8);
+  const __m128i bits_hi = _mm_setr_epi32 (16, 32, 64, 128);
+  const __m128i bg = _mm_set1_epi32 ((gint) palette->background);
+  __m128i *out = (__m128i *) dest;
+  guint x;
+
+  /* non-temporal stores need 16 byte alignment, cells keep it once the
+   * row start has it */
+  stream = stream && ((guintptr) dest & 15) == 0;
+
+  for (x = 0; x < n_cells; x++) {
+    __m128i fg = _mm_set1_epi32 ((gint) palette->colors[classes[x]]);
+    __m128i glyph = _mm_set1_epi32 (glyphs[x]);
+    __m128i mask_lo =
+        _mm_cmpeq_epi32 (_mm_and_si128 (glyph, bits_lo), bits_lo);
+    __m128i mask_hi =
+        _mm_cmpeq_epi32 (_mm_and_si128 (glyph, bits_hi), bits_hi);
+    __m128i lo = _mm_or_si128 (_mm_and_si128 (mask_lo, fg),
+        _mm_andnot_si128 (mask_lo, bg));
+    __m128i hi = _mm_or_si128 (_mm_and_si128 (mask_hi, fg),
+        _mm_andnot_si128 (mask_hi, bg));
+
+    if (stream) {
+      _mm_stream_si128 (out, lo);
+      _mm_stream_si128 (out + 1, hi);
+    } else {
+      _mm_storeu_si128 (out, lo);
+      _mm_storeu_si128 (out + 1, hi);
+    }
+    out += 2;
+  }
+}
+
+__attribute__ ((target ("avx2")))
+static void
+gst_aatv_render_row_avx2 (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  const __m256i bits = _mm256_setr_epi32 (1, 2, 4, 8, 16, 32, 64, 128);
+  const __m256i bg = _mm256_set1_epi32 ((gint) palette->background);
+  __m256i *out = (__m256i *) dest;
+  guint x;
+
+  stream = stream && ((guintptr) dest & 31) == 0;
+
+  for (x = 0; x < n_cells; x++) {
+    __m256i fg = _mm256_set1_epi32 ((gint) palette->colors[classes[x]]);
+    __m256i glyph = _mm256_set1_epi32 (glyphs[x]);
+    __m256i mask = _mm256_cmpeq_epi32 (_mm256_and_si256 (glyph, bits), bits);
+    __m256i pixels = _mm256_blendv_epi8 (bg, fg, mask);
+
+    if (stream)
+      _mm256_stream_si256 (out, pixels);
+    else
+      _mm256_storeu_si256 (out, pixels);
+    out++;
+  }
+}
+
+__attribute__ ((target ("sse2")))
+static void
+gst_aatv_render_sfence (void)
+{
+  _mm_sfence ();
+}
+
+static gboolean
+gst_aatv_render_have_sse2 (void)
+{
+  return __builtin_cpu_supports ("sse2");
+}
+
+static gboolean
+gst_aatv_render_have_avx2 (void)
+{
+  return __builtin_cpu_supports ("avx2");
+}
+#endif
+
+#ifdef GST_AATV_HAVE_NEON
+/* ARM has no portable non-temporal store intrinsic, the stream hint is
+ * ignored here */
+static void
+gst_aatv_render_row_neon (guint8 * dest, const guint8 * glyphs,
+    const guint8 * classes, guint n_cells, const GstAATvPalette * palette,
+    gboolean stream)
+{
+  static const guint32 bit_values[8] = { 1, 2, 4, 8, 16, 32, 64, 128 };
+  const uint32x4_t bits_lo = vld1q_u32 (bit_values);
+  const uint32x4_t bits_hi = vld1q_u32 (bit_values + 4);
+  const uint32x4_t bg = vdupq_n_u32 (palette->background);
+  guint32 *out = (guint32 *) dest;
+  guint x;
+
+  for (x = 0; x < n_cells; x++) {
+    uint32x4_t fg = vdupq_n_u32 (palette->colors[classes[x]]);
+    uint32x4_t glyph = vdupq_n_u32 (glyphs[x]);
+
+    vst1q_u32 (out, vbslq_u32 (vtstq_u32 (glyph, bits_lo), fg, bg));
+    vst1q_u32 (out + 4, vbslq_u32 (vtstq_u32 (glyph, bits_hi), fg, bg));
+    out += 8;
+  }
+}
+
+static gboolean
+gst_aatv_render_have_neon (void)
+{
+  return TRUE;
+}
+#endif
+
+static gboolean
+gst_aatv_render_have_scalar (void)
+{
+  return TRUE;
+}
+
+typedef struct
+{
+  const gchar *name;
+  GstAATvRowFunc row_func;
+    gboolean (*supported) (void);
+} GstAATvKernel;
+
+/* in order of preference */
+static const GstAATvKernel kernels[] = {
+#ifdef GST_AATV_HAVE_X86
+  {"avx2", gst_aatv_render_row_avx2, gst_aatv_render_have_avx2},
+  {"sse2", gst_aatv_render_row_sse2, gst_aatv_render_have_sse2},
+#endif
+#ifdef GST_AATV_HAVE_NEON
+  {"neon", gst_aatv_render_row_neon, gst_aatv_render_have_neon},
+#endif
+  {"scalar", gst_aatv_render_row_scalar, gst_aatv_render_have_scalar},
+};
+
+static const GstAATvKernel *kernel;
+
+/* returns the kernel for the first plane of format, only RGBA has a choice
+ * of kernels */
+GstAATvRowFunc
+gst_aatv_render_get_row_func (GstVideoFormat format, const gchar ** name)
+{
+  static gsize selected = 0;
+
+  switch (format) {
+    case GST_VIDEO_FORMAT_GRAY8:
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:
+      if (name)
+        *name = "scalar";
+      return gst_aatv_render_row_span8;
+    case GST_VIDEO_FORMAT_RGB16:
+      if (name)
+        *name = "scalar";
+      return gst_aatv_render_row_span16;
+    default:
+      break;
+  }
+
+  if (g_once_init_enter (&selected)) {
+    const gchar *forced = g_getenv ("GST_AATV_KERNEL");
+    guint i;
+
+    if (forced != NULL && *forced == '\0')
+      forced = NULL;
+
+    kernel = &kernels[G_N_ELEMENTS (kernels) - 1];
+    for (i = 0; i < G_N_ELEMENTS (kernels); i++) {
+      if (forced != NULL && strcmp (forced, kernels[i].name) != 0)
+        continue;
+      if (kernels[i].supported ()) {
+        kernel = &kernels[i];
+        break;
+      }
+    }
+    GST_INFO ("using %s glyph expansion kernel", kernel->name);
+    g_once_init_leave (&selected, 1);
+  }
+
+  if (name)
+    *name = kernel->name;
+  return kernel->row_func;
+}
+
+/* enumerates the RGBA kernels built in, func is NULL when the CPU can't run
+ * the kernel. Returns FALSE past the last one. */
+gboolean
+gst_aatv_render_get_kernel (guint index, const gchar ** name,
+    GstAATvRowFunc * func)
+{
+  if (index >= G_N_ELEMENTS (kernels))
+    return FALSE;
+
+  *name = kernels[index].name;
+  *func = kernels[index].supported () ? kernels[index].row_func : NULL;
+
+  return TRUE;
+}
+
+/* order non-temporal stores before the frame is handed downstream */
+void
+gst_aatv_render_stream_fence (void)
+{
+#ifdef GST_AATV_HAVE_X86
+  /* only the x86 vector kernels issue streaming stores */
+  if (kernel != NULL && kernel->row_func != gst_aatv_render_row_scalar)
+    gst_aatv_render_sfence ();
+#endif
+}
@@ -0,0 +1,91 @@
+/* GStreamer
+* Copyright (C) <1999> Erik Walthinsen <omega@cse.ogi.edu>
+*
+* This library is free software; you can redistribute it and/or
+* modify it under the terms of the GNU Library General Public
+* License as published by the Free Software Foundation; either
+* version 2 of the License, or (at your option) any later version.
+*
+* This library is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+* Library General Public License for more details.
+*
+* You should have received a copy of the GNU Library General Public
+* License along with this library; if not, write to the
+* Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+* Boston, MA 02110-1301, USA.
+*/
+
+
+#ifndef __GST_AATV_RENDER_H__
+#define __GST_AATV_RENDER_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+/* output formats the palette can be built for */
+#define GST_AATV_RENDER_FORMATS "{ RGBA, GRAY8, RGB16, I420, NV12 }"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+	typedef struct _GstAATvPalette GstAATvPalette;
+
+	/* foreground color a glyph is drawn in, chosen per cell */
+	typedef enum {
+		GST_AATV_CLASS_TEXT_NORMAL,
+		GST_AATV_CLASS_TEXT_DIM,
+		GST_AATV_CLASS_TEXT_BOLD,
+		GST_AATV_CLASS_RAIN_NORMAL,
+		GST_AATV_CLASS_RAIN_DIM,
+		GST_AATV_CLASS_RAIN_BOLD,
+		GST_AATV_N_CLASSES
+	} GstAATvColorClass;
+
+	struct _GstAATvPalette {
+		/* colors as set on the element, RGBA in memory order */
+		guint32 colors[GST_AATV_N_CLASSES];
+		guint32 background;
+
+		/* output format, bytes per pixel of its first plane */
+		GstVideoFormat format;
+		guint pstride;
+
+		/* ready made 8 pixel spans of the first plane, indexed by color
+		 * class and glyph row byte */
+		guint8 * spans;
+
+		/* I420 and NV12: U and V of two horizontally adjacent pixels added
+		 * up, indexed by color class and the two glyph bits */
+		guint16 chroma_u[GST_AATV_N_CLASSES][4];
+		guint16 chroma_v[GST_AATV_N_CLASSES][4];
+	};
+
+	/* expands one row of glyph bytes (bit 0 is the leftmost pixel) into
+	 * 8 pixels per cell, colored by the matching entry in classes */
+	typedef void (*GstAATvRowFunc) (guint8 * dest, const guint8 * glyphs,
+			const guint8 * classes, guint n_cells,
+			const GstAATvPalette * palette, gboolean stream);
+
+	void gst_aatv_palette_update (GstAATvPalette * palette);
+	void gst_aatv_palette_free (GstAATvPalette * palette);
+	gboolean gst_aatv_palette_has_chroma (const GstAATvPalette * palette);
+
+	GstAATvRowFunc gst_aatv_render_get_row_func (GstVideoFormat format,
+			const gchar ** name);
+	void gst_aatv_render_chroma_row (guint8 * u, guint8 * v, guint pstride,
+			const guint8 * glyphs0, const guint8 * classes0,
+			const guint8 * glyphs1, const guint8 * classes1, guint n_cells,
+			const GstAATvPalette * palette);
+	void gst_aatv_render_stream_fence (void);
+	gboolean gst_aatv_render_get_kernel (guint index, const gchar ** name,
+			GstAATvRowFunc * func);
+
+#ifdef __cplusplus
+}
+#endif /* __cplusplus */
+
+
+#endif /* __GST_AATV_RENDER_H__ */